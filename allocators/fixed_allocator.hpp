@@ -3,8 +3,8 @@
 #include "fixed_pool.hpp"
 #include "construct_destroy.hpp"
 
+#include <boost/atomic.hpp>
 #include <boost/intrusive_ptr.hpp>
-#include <boost/thread/once.hpp>
 
 #include <limits>
 
@@ -16,6 +16,8 @@ namespace tcl { namespace allocators {
 /// Memory pool is created on first allocation attempt. After this memory pool
 /// is tuned to specific object size. All attempts to allocate something that
 /// cannot be satisfied by memory pool will be redirected to FallbackAllocator.
+/// If several threads make first allocation simultaneously, only one pool wins,
+/// others are destroyed right away.
 ///
 /// \tparam T - type of objects to allocate. Used to evaluate object size
 /// \tparam ChunksNum - number of chunks in memory pool
@@ -74,10 +76,15 @@ public:
     };
 
     fixed_allocator();
+    fixed_allocator(const fixed_allocator& other);
 
     template<typename T1, typename FallbackAllocator1>
     fixed_allocator(const fixed_allocator<T1, ChunksNum, FallbackAllocator1>& other);
 
+    ~fixed_allocator();
+
+    fixed_allocator& operator=(const fixed_allocator& other);
+
     pointer address(reference x) const;
     const_pointer address(const_reference x) const;
 
@@ -91,19 +98,64 @@ public:
     void destroy(pointer p);
 
 private:
-    fixed_pool_ptr   pool_;
+    void adopt(const fixed_pool_ptr& pool);
+
+    // Raw pointer holding one reference, so that lazy creation can be done with CAS
+    boost::atomic<fixed_pool_type*> pool_;
 };
 
 template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
 fixed_allocator<T, ChunksNum, FallbackAllocator>::fixed_allocator()
+    : pool_(0)
+{
+}
+
+template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
+fixed_allocator<T, ChunksNum, FallbackAllocator>::fixed_allocator(const fixed_allocator& other)
+    : super(other)
+    , pool_(0)
 {
+    adopt(other.pool());
 }
 
 template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
 template<typename T1, typename FallbackAllocator1>
 fixed_allocator<T, ChunksNum, FallbackAllocator>::fixed_allocator(const fixed_allocator<T1, ChunksNum, FallbackAllocator1>& other)
-    : pool_(other.pool())
+    : pool_(0)
 {
+    adopt(other.pool());
+}
+
+template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
+fixed_allocator<T, ChunksNum, FallbackAllocator>::~fixed_allocator()
+{
+    if (fixed_pool_type* pool = pool_.load(boost::memory_order_relaxed))
+        intrusive_ptr_release(pool);
+}
+
+template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
+auto
+fixed_allocator<T, ChunksNum, FallbackAllocator>::operator=(const fixed_allocator& other) -> fixed_allocator&
+{
+    fixed_pool_ptr pool = other.pool();
+    if (pool)
+        intrusive_ptr_add_ref(pool.get());
+
+    if (fixed_pool_type* old = pool_.exchange(pool.get(), boost::memory_order_acq_rel))
+        intrusive_ptr_release(old);
+
+    return *this;
+}
+
+template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
+void
+fixed_allocator<T, ChunksNum, FallbackAllocator>::adopt(const fixed_pool_ptr& pool)
+{
+    if (pool)
+    {
+        intrusive_ptr_add_ref(pool.get());
+        pool_.store(pool.get(), boost::memory_order_release);
+    }
 }
 
 template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
@@ -122,16 +174,23 @@ template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
 auto
 fixed_allocator<T, ChunksNum, FallbackAllocator>::allocate(size_type n, void* hint) -> pointer
 {
-    if (!pool_)
+    fixed_pool_type* pool = pool_.load(boost::memory_order_acquire);
+    if (!pool)
     {
-        // TODO: Here is race, if two threads call us simultaniously
         fixed_pool_allocator allocator(*(super*)this);
-        pool_.reset(::tcl::allocators::construct(allocator, ChunksNum, sizeof(T)));
+        fixed_pool_type* new_pool = ::tcl::allocators::construct(allocator, ChunksNum, sizeof(T));
+        intrusive_ptr_add_ref(new_pool);
+
+        if (pool_.compare_exchange_strong(pool, new_pool, boost::memory_order_acq_rel, boost::memory_order_acquire))
+            pool = new_pool;
+        else
+            intrusive_ptr_release(new_pool);
     }
-    else if (1 != n || pool_->chunk_size() != sizeof(T))
+
+    if (1 != n || pool->chunk_size() != sizeof(T))
         return super::allocate(n, hint);
 
-    pointer result = static_cast<pointer>(pool_->allocate());
+    pointer result = static_cast<pointer>(pool->allocate());
     if (!result)
         result = super::allocate(n, hint);
 
@@ -142,10 +201,11 @@ template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
 void
 fixed_allocator<T, ChunksNum, FallbackAllocator>::deallocate(pointer p, size_type n)
 {
-    assert("Ensure that allocate was already called" && pool_);
+    fixed_pool_type* pool = pool_.load(boost::memory_order_acquire);
+    assert("Ensure that allocate was already called" && pool);
 
-    if (1 == n && pool_->is_my_ptr(p))
-        pool_->deallocate(p);
+    if (1 == n && pool->is_my_ptr(p))
+        pool->deallocate(p);
     else
         super::deallocate(p, n);
 }
@@ -162,7 +222,7 @@ template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
 auto
 fixed_allocator<T, ChunksNum, FallbackAllocator>::pool() const -> fixed_pool_ptr
 {
-    return pool_;
+    return fixed_pool_ptr(pool_.load(boost::memory_order_acquire));
 }
 
 template<typename T, unsigned short ChunksNum, typename FallbackAllocator>
@@ -2,6 +2,8 @@
 
 #include "construct_destroy.hpp"
 
+#include <tcl/statistics.hpp>
+
 #include <boost/atomic.hpp>
 #include <boost/cstdint.hpp>
 
@@ -58,6 +60,10 @@ public:
     /// Return copy of allocator
     allocator_type get_allocator() const;
 
+    /// Return CAS failures of allocate and deallocate, zeros unless
+    /// built with TCL_STATISTICS
+    statistics get_statistics() const;
+
 private:
     friend void intrusive_ptr_add_ref(fixed_pool* p)
     {
@@ -92,6 +98,7 @@ private:
 
     boost::atomic<chunk_ref> head_;  //!< Index of first free chunk with generation number
     boost::atomic_int ref_count_;    //!< Reference counter for boost::intrusive_ptr
+    statistics_counters stats_;      //!< CAS failures, compiled in with TCL_STATISTICS
 };
 
 template<typename Allocator>
@@ -100,6 +107,7 @@ fixed_pool<Allocator>::fixed_pool(size_type chunks_num, size_t chunk_size, const
     , chunks_num_(chunks_num)
     , chunk_size_(chunk_size > sizeof(size_type) ? chunk_size : sizeof(size_type))
     , total_size_(chunk_size_ * chunks_num_)
+    , ref_count_(0)
 {
     // Allocate char array using provided self rebounded allocator
     chunks_ = construct_array(*(allocator_type*)this, total_size_);
@@ -131,17 +139,25 @@ void* fixed_pool<Allocator>::allocate()
     chunk_ref new_head;
 
     void* res;
+    unsigned failures = 0;
 
-    do {
+    for(;; ++failures)
+    {
         if (old_head.idx_ == chunks_num_)
+        {
+            stats_.operation(failures);
             return 0;
+        }
 
         res = chunks_ + chunk_size_ * old_head.idx_;
         new_head.idx_ = *reinterpret_cast<size_type*>(res);
         new_head.generation_ = old_head.generation_ + 1;
+
+        if (head_.compare_exchange_weak(old_head, new_head))
+            break;
     }
-    while(!head_.compare_exchange_weak(old_head, new_head));
 
+    stats_.operation(failures);
     return res;
 }
 
@@ -154,14 +170,20 @@ void fixed_pool<Allocator>::deallocate(void* p)
     chunk_ref new_head;
 
     size_type& new_idx = *reinterpret_cast<size_type*>(p);
+    unsigned failures = 0;
 
-    do {
+    for(;; ++failures)
+    {
         new_idx = old_head.idx_;
 
         new_head.idx_ = (reinterpret_cast<char*>(p) - chunks_) / chunk_size_;
         new_head.generation_ = old_head.generation_ + 1;
+
+        if (head_.compare_exchange_weak(old_head, new_head))
+            break;
     }
-    while(!head_.compare_exchange_weak(old_head, new_head));
+
+    stats_.operation(failures);
 }
 
 template<typename Allocator>
@@ -182,4 +204,10 @@ auto fixed_pool<Allocator>::get_allocator() const -> allocator_type
     return *this;
 }
 
+template<typename Allocator>
+statistics fixed_pool<Allocator>::get_statistics() const
+{
+    return stats_.get();
+}
+
 }}
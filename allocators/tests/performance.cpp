@@ -2,12 +2,15 @@
 #include "../fixed_allocator.hpp"
 #include "../fixed_object_pool.hpp"
 
+#include <tcl/perf_counters.hpp>
+
 #include <boost/chrono/chrono.hpp>
 #include <boost/chrono/chrono_io.hpp>
 
 #include <vector>
 #include <iostream>
 #include <functional>
+#include <string>
 
 const size_t attempts = 15000;
 
@@ -18,10 +21,17 @@ using namespace tcl::allocators;
 
 std::vector<test_type*> g_ptrs(attempts);
 
+// Print hardware counters per operation, set by --perf
+bool g_perf = false;
+
 template<typename Allocator>
 void test_al(Allocator& al)
 {
+    tcl::perf_counters allocate_perf(g_perf);
+    tcl::perf_counters deallocate_perf(g_perf);
+
     clock_type::time_point tp1 = clock_type::now();
+    allocate_perf.start();
 
     for(int i = 0; i<attempts; ++i)
     {
@@ -29,19 +39,39 @@ void test_al(Allocator& al)
         *(g_ptrs[i]) = i;
     }
 
+    allocate_perf.stop();
     clock_type::time_point tp2 = clock_type::now();
+    deallocate_perf.start();
 
     for(int i = 0; i<attempts; ++i)
         al.deallocate(g_ptrs[i], 1);
 
+    deallocate_perf.stop();
     clock_type::time_point tp3 = clock_type::now();
 
     std::cout << typeid(Allocator).name() << std::endl
         << tp2 - tp1 << std::endl << tp3 - tp1 << std::endl;
+
+    if (allocate_perf.available())
+    {
+        std::cout << "allocate:";
+        allocate_perf.print_per_op(std::cout, attempts);
+        std::cout << std::endl << "deallocate:";
+        deallocate_perf.print_per_op(std::cout, attempts);
+        std::cout << std::endl;
+    }
 }
 
 int main(int argc, char* argv[])
 {
+    g_perf = argc > 1 && std::string(argv[1]) == "--perf";
+    if (g_perf)
+    {
+        tcl::perf_counters perf;
+        perf.print_availability(std::cout);
+        std::cout << std::endl;
+    }
+
     fixed_allocator<test_type, attempts> my;
     std::allocator<test_type> def;
 
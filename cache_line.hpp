@@ -0,0 +1,58 @@
+///
+/// \file
+///
+/// \brief Cache line size used to keep data written by different threads
+/// on different cache lines.
+///
+/// Size is taken from TCL_CACHE_LINE_SIZE. Cmake detects it on build machine
+/// (cache variable of the same name), set it explicitly when target machine
+/// differs. Without it 128 is assumed on powerpc64 and apple arm, 64
+/// everywhere else.
+///
+/// Layout is done with padding, not with alignas: containers and their
+/// records are created by operator new and user allocators, which don`t
+/// honour over-aligned types before C++17. Padding of \c cache_line_size
+/// bytes keeps apart what is on its two sides, whatever the alignment of
+/// object is, so contended members are always followed (and, when object
+/// may neighbour other hot data, preceded) by
+/// \code char padN_[cache_line_size]; \endcode
+/// It doesn`t keep a multi-word member on one line though: unaligned
+/// 40 bytes element padded to 64 may still span two lines and share both
+/// with its neighbours. Arrays of such elements are allocated separately
+/// with base aligned by hand and elements padded up to whole lines, as
+/// \c statistics_counters does with its shards.
+///
+
+#ifndef TCL_CACHE_LINE_INCLUDED
+#define TCL_CACHE_LINE_INCLUDED
+
+#include <boost/static_assert.hpp>
+
+#include <cstddef>
+
+#if !defined(TCL_CACHE_LINE_SIZE)
+#  if defined(__powerpc64__) || defined(__ppc64__) || (defined(__APPLE__) && defined(__aarch64__))
+#    define TCL_CACHE_LINE_SIZE 128
+#  else
+#    define TCL_CACHE_LINE_SIZE 64
+#  endif
+#endif
+
+namespace tcl {
+
+const std::size_t cache_line_size = TCL_CACHE_LINE_SIZE;
+
+BOOST_STATIC_ASSERT_MSG(
+    cache_line_size >= 16 && !(cache_line_size & (cache_line_size - 1)),
+    "TCL_CACHE_LINE_SIZE must be power of two, at least 16");
+
+/// Padding that rounds \c size bytes up to whole cache lines, never zero
+template<std::size_t Size>
+struct cache_line_tail
+{
+    static const std::size_t value = cache_line_size - Size % cache_line_size;
+};
+
+}
+
+#endif
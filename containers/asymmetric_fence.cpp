@@ -0,0 +1,67 @@
+#include "asymmetric_fence.hpp"
+
+#if defined(__linux__)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace tcl { namespace containers {
+
+namespace {
+
+#if defined(__linux__) && defined(SYS_membarrier)
+
+int membarrier(int cmd)
+{
+    return static_cast<int>(syscall(SYS_membarrier, cmd, 0));
+}
+
+bool init_available()
+{
+    const int supported = membarrier(MEMBARRIER_CMD_QUERY);
+    if (supported < 0 || !(supported & MEMBARRIER_CMD_PRIVATE_EXPEDITED))
+        return false;
+
+    return 0 == membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED);
+}
+
+#elif defined(_WIN32)
+
+bool init_available()
+{
+    return true;
+}
+
+#else
+
+bool init_available()
+{
+    return false;
+}
+
+#endif
+
+}
+
+// Light side uses full fence until this is initialized, which is always correct
+boost::atomic<bool> asymmetric_fence::available_(init_available());
+
+void asymmetric_fence::heavy()
+{
+    if (!available_.load(boost::memory_order_relaxed))
+    {
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        return;
+    }
+
+#if defined(__linux__) && defined(SYS_membarrier)
+    membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED);
+#elif defined(_WIN32)
+    FlushProcessWriteBuffers();
+#endif
+}
+
+}}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <boost/atomic.hpp>
+
+namespace tcl { namespace containers {
+
+/// \brief Memory fence split into cheap and expensive halves.
+///
+/// Thread on the frequent path calls \c light, thread on the rare path calls
+/// \c heavy. Together they order memory as if both threads issued full fence:
+/// \c heavy makes every running thread of the process execute full barrier.
+/// On Linux it is membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED), on Windows
+/// FlushProcessWriteBuffers. Then \c light is just compiler barrier.
+/// If none of them is available, both halves are full fences.
+class asymmetric_fence
+{
+public:
+    static void light()
+    {
+        if (available_.load(boost::memory_order_relaxed))
+            boost::atomic_signal_fence(boost::memory_order_seq_cst);
+        else
+            boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    }
+
+    static void heavy();
+
+    /// Return true if \c light is compiler barrier only
+    static bool is_asymmetric()
+    {
+        return available_.load(boost::memory_order_relaxed);
+    }
+
+private:
+    /// Set once on start up, when system call is registered, and never reset
+    static boost::atomic<bool> available_;
+};
+
+}}
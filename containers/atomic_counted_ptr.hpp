@@ -0,0 +1,215 @@
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/static_assert.hpp>
+
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+#if (defined(__GNUC__) && defined(__x86_64__)) || (defined(_MSC_VER) && defined(_M_X64))
+#define TCL_CONTAINERS_CMPXCHG16B
+#endif
+
+namespace tcl { namespace containers {
+
+/// \brief Pointer with external reference count, for split reference counting.
+///
+/// Count is pointer sized, so that structure has no padding bytes, CAS
+/// compares whole object representation and garbage in padding makes
+/// it fail forever.
+template<typename T>
+struct counted_ptr
+{
+    boost::intptr_t external_count_;
+    T* node_;
+};
+
+#if defined(TCL_CONTAINERS_CMPXCHG16B)
+
+namespace detail {
+
+/// Compare 16 bytes at dst with expected, store desired if equal,
+/// otherwise write actual value to expected. Full fence.
+inline bool cmpxchg16b(volatile boost::uint64_t* dst, boost::uint64_t* expected, const boost::uint64_t* desired)
+{
+#if defined(_MSC_VER)
+    return _InterlockedCompareExchange128(
+        reinterpret_cast<volatile __int64*>(dst)
+      , static_cast<__int64>(desired[1])
+      , static_cast<__int64>(desired[0])
+      , reinterpret_cast<__int64*>(expected)
+      ) != 0;
+#else
+    bool result;
+    __asm__ __volatile__
+    (
+        "lock; cmpxchg16b %1\n\t"
+        "sete %0"
+        : "=q" (result), "+m" (*dst), "+a" (expected[0]), "+d" (expected[1])
+        : "b" (desired[0]), "c" (desired[1])
+        : "cc", "memory"
+    );
+    return result;
+#endif
+}
+
+}
+
+/// \brief Atomic counted_ptr, that is lock-free regardless of compiler flags.
+///
+/// boost::atomic falls back to spinlock pool for 16 byte objects unless
+/// compiler is allowed to emit cmpxchg16b (-mcx16 for gcc), which silently
+/// turns lock-free containers into lock-based ones. Here cmpxchg16b is used
+/// directly, every x86-64 cpu made after 2006 has it. Counter is not packed
+/// into unused pointer bits, queue increments it on every empty poll and
+/// 16 bits would wrap.
+///
+/// Every operation except \c peek is locked instruction and acts as full
+/// fence, memory order arguments are accepted for compatibility with
+/// boost::atomic. That includes \c load, which takes the line exclusive
+/// like a store, so code that tolerates torn pair should \c peek.
+///
+/// cmpxchg16b faults on address that isn`t 16 byte aligned, while nodes and
+/// containers come from user allocators that guarantee 8 at most. So value
+/// is kept in 24 byte buffer and its aligned half is found by hand, see
+/// \c cache_line.hpp for why alignas is not used.
+template<typename T>
+class atomic_counted_ptr
+{
+    typedef counted_ptr<T> value_type;
+
+    BOOST_STATIC_ASSERT_MSG(sizeof(value_type) == 16, "counted_ptr must be exactly 16 bytes");
+
+    atomic_counted_ptr(const atomic_counted_ptr&);
+    atomic_counted_ptr& operator=(const atomic_counted_ptr&);
+
+public:
+    static const bool is_always_lock_free = true;
+
+    atomic_counted_ptr()
+    {
+        storage()[0] = 0;
+        storage()[1] = 0;
+    }
+
+    bool is_lock_free() const
+    {
+        return true;
+    }
+
+    value_type load(boost::memory_order = boost::memory_order_seq_cst) const
+    {
+        // CAS of zero with zero doesn`t change value and returns actual one
+        boost::uint64_t expected[2] = {0, 0};
+        detail::cmpxchg16b(storage(), expected, expected);
+        return from_words(expected);
+    }
+
+    /// Reads two words with plain loads, doesn`t write the line like \c load.
+    /// Pair may be torn, use it to seed CAS loop, which fails on torn value
+    /// and gets actual one, or when only one of the words is needed.
+    value_type peek() const
+    {
+        const volatile boost::uint64_t* const s = storage();
+        const boost::uint64_t words[2] = {s[0], s[1]};
+        return from_words(words);
+    }
+
+    void store(const value_type& desired, boost::memory_order order = boost::memory_order_seq_cst)
+    {
+        exchange(desired, order);
+    }
+
+    value_type exchange(const value_type& desired, boost::memory_order = boost::memory_order_seq_cst)
+    {
+        volatile boost::uint64_t* const s = storage();
+        boost::uint64_t expected[2] = {s[0], s[1]};
+        boost::uint64_t words[2];
+        to_words(desired, words);
+
+        while (!detail::cmpxchg16b(s, expected, words));
+        return from_words(expected);
+    }
+
+    bool compare_exchange_strong(
+        value_type& expected
+      , const value_type& desired
+      , boost::memory_order = boost::memory_order_seq_cst
+      , boost::memory_order = boost::memory_order_seq_cst)
+    {
+        boost::uint64_t expected_words[2];
+        boost::uint64_t desired_words[2];
+        to_words(expected, expected_words);
+        to_words(desired, desired_words);
+
+        if (detail::cmpxchg16b(storage(), expected_words, desired_words))
+            return true;
+
+        expected = from_words(expected_words);
+        return false;
+    }
+
+    bool compare_exchange_weak(
+        value_type& expected
+      , const value_type& desired
+      , boost::memory_order success = boost::memory_order_seq_cst
+      , boost::memory_order failure = boost::memory_order_seq_cst)
+    {
+        return compare_exchange_strong(expected, desired, success, failure);
+    }
+
+private:
+    /// 16 byte aligned half of buffer
+    volatile boost::uint64_t* storage() const
+    {
+        const boost::uintptr_t p = reinterpret_cast<boost::uintptr_t>(buffer_);
+        return reinterpret_cast<volatile boost::uint64_t*>((p + 15) & ~boost::uintptr_t(15));
+    }
+
+    static void to_words(const value_type& v, boost::uint64_t* words)
+    {
+        std::memcpy(words, &v, sizeof(v));
+    }
+
+    static value_type from_words(const boost::uint64_t* words)
+    {
+        value_type v;
+        std::memcpy(&v, words, sizeof(v));
+        return v;
+    }
+
+    volatile boost::uint64_t buffer_[3];
+};
+
+#else
+
+/// \brief Atomic counted_ptr on top of boost::atomic.
+///
+/// Fails to compile when boost::atomic can`t do double width CAS without
+/// lock on this platform, lock-free container must not silently become
+/// lock-based one.
+template<typename T>
+class atomic_counted_ptr : public boost::atomic<counted_ptr<T> >
+{
+    BOOST_STATIC_ASSERT_MSG(
+        (sizeof(counted_ptr<T>) == 8 && BOOST_ATOMIC_INT64_LOCK_FREE == 2) ||
+        (sizeof(counted_ptr<T>) == 16 && BOOST_ATOMIC_INT128_LOCK_FREE == 2),
+        "Double width CAS is not lock-free, enable it in compiler flags (-mcx16 for gcc)");
+
+public:
+    static const bool is_always_lock_free = true;
+
+    /// Same as load, double width load is never torn here
+    counted_ptr<T> peek() const
+    {
+        return this->load();
+    }
+};
+
+#endif
+
+}}
@@ -0,0 +1,17 @@
+#pragma once
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#endif
+
+namespace tcl { namespace containers { namespace detail {
+
+/// Hint to processor that we are in spin loop
+inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    _mm_pause();
+#endif
+}
+
+}}}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "cpu_relax.hpp"
+
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/static_assert.hpp>
+
+namespace tcl { namespace containers {
+
+namespace detail {
+
+/// Cheap per thread pseudo random numbers, xorshift
+inline boost::uint32_t elimination_random()
+{
+    static thread_local boost::uint32_t seed = 0;
+    if (!seed)
+        seed = static_cast<boost::uint32_t>(reinterpret_cast<boost::uintptr_t>(&seed) >> 4) | 1;
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+}
+
+/// \brief Elimination policy that does nothing. Default for lock-free stacks.
+struct no_elimination
+{
+    bool offer(void*)
+    {
+        return false;
+    }
+
+    void* take()
+    {
+        return 0;
+    }
+};
+
+/// \brief Elimination policy for lock-free stacks.
+///
+/// When push or pop fails CAS on stack head, it visits random slot of
+/// elimination array instead of retrying immediately. Pusher leaves there
+/// its node and waits a bit, popper that comes to the same slot takes node
+/// directly, so both operations complete without touching stack head.
+/// See "A Scalable Lock-free Stack Algorithm" by Hendler, Shavit and Yerushalmi.
+///
+/// Slot is empty (0), holds offered node or \c taken mark. Only pusher that
+/// made offer resets \c taken back to empty, so withdrawal CAS can`t succeed
+/// on node that was taken and then reused for another offer.
+///
+/// \tparam Slots - number of slots, power of two.
+/// \tparam SpinCount - how long pusher waits for popper.
+template<size_t Slots = 8, unsigned SpinCount = 128>
+class elimination_array
+{
+    BOOST_STATIC_ASSERT_MSG(Slots && !(Slots & (Slots - 1)), "Slots must be power of two");
+
+    struct slot
+    {
+        boost::atomic<void*> node_;
+        char pad_[cache_line_tail<sizeof(boost::atomic<void*>)>::value];
+    };
+
+    static void* taken()
+    {
+        return reinterpret_cast<void*>(1);
+    }
+
+    elimination_array(const elimination_array&);
+    elimination_array& operator=(const elimination_array&);
+
+public:
+    elimination_array()
+    {
+        for (size_t i = 0; i < Slots; ++i)
+            slots_[i].node_.store(0, boost::memory_order_relaxed);
+    }
+
+    /// Offer node to popper. Return true if it was taken,
+    /// false if node still belongs to caller.
+    bool offer(void* node)
+    {
+        slot& s = slots_[detail::elimination_random() & (Slots - 1)];
+
+        void* expected = 0;
+        if (!s.node_.compare_exchange_strong(
+                expected, node, boost::memory_order_release, boost::memory_order_relaxed))
+            return false;
+
+        for (unsigned i = 0; i < SpinCount; ++i)
+        {
+            if (s.node_.load(boost::memory_order_acquire) == taken())
+            {
+                s.node_.store(0, boost::memory_order_relaxed);
+                return true;
+            }
+
+            detail::cpu_relax();
+        }
+
+        expected = node;
+        if (s.node_.compare_exchange_strong(
+                expected, 0, boost::memory_order_acquire, boost::memory_order_acquire))
+            return false;
+
+        // Popper came in the last moment
+        s.node_.store(0, boost::memory_order_relaxed);
+        return true;
+    }
+
+    /// Take node offered by pusher, return 0 if there is none.
+    void* take()
+    {
+        slot& s = slots_[detail::elimination_random() & (Slots - 1)];
+
+        void* node = s.node_.load(boost::memory_order_acquire);
+        if (!node || node == taken())
+            return 0;
+
+        if (s.node_.compare_exchange_strong(
+                node, taken(), boost::memory_order_acquire, boost::memory_order_relaxed))
+            return node;
+
+        return 0;
+    }
+
+private:
+    slot slots_[Slots];
+};
+
+}}
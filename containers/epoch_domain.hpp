@@ -0,0 +1,310 @@
+#pragma once
+
+#include "hazard_pointers_reclaim_list.hpp"
+#include "thread_record_cache.hpp"
+
+#include <tcl/cache_line.hpp>
+#include <tcl/statistics.hpp>
+
+#include <boost/atomic.hpp>
+
+#include <cassert>
+
+namespace tcl { namespace containers {
+
+namespace detail {
+
+/// Thread announce record and limbo lists, one per thread per domain
+struct epoch_record
+{
+    static const unsigned limbo_count = 3;
+
+    epoch_record()
+        : announce_(0)
+        , in_use_(false)
+        , next_(0)
+        , nesting_(0)
+    {
+        for (unsigned i = 0; i < limbo_count; ++i)
+            limbo_epoch_[i] = 0;
+    }
+
+    char pad0_[cache_line_size];
+
+    // Read by threads that try to advance epoch
+
+    /// (epoch << 1) | 1 while thread is inside guard, 0 otherwise
+    boost::atomic<unsigned> announce_;
+
+    boost::atomic<bool> in_use_;
+    epoch_record* next_;
+    char pad1_[cache_line_size];
+
+    // Touched only by owner
+
+    unsigned nesting_;
+
+    /// Nodes retired in epoch limbo_epoch_[i] are in limbo_[i]
+    hazard_pointers_reclaim_list limbo_[limbo_count];
+    unsigned limbo_epoch_[limbo_count];
+    char pad2_[cache_line_size];
+};
+
+}
+
+/// \brief Epoch based reclamation domain.
+///
+/// Readers only announce global epoch on entering guard, so protecting
+/// pointer is plain load and there is no per pointer scan on reclaim.
+/// Global epoch advances when all threads inside guards have announced it.
+/// Node is put to limbo list of epoch e that retiring thread has announced,
+/// global epoch may be e + 1 by then, so node is safe once global epoch
+/// reaches e + 3. Thread frees its list of epoch e when it retires again in
+/// epoch e + 3 or later and reuses the list, so each thread holds at most
+/// three epochs of its own garbage. Thread stuck in guard blocks reclamation
+/// for everybody, so guards must be short. See "Practical lock-freedom" by
+/// Keir Fraser.
+///
+/// When thread exits, it frees limbo lists that are already safe and pushes
+/// the rest to domain`s orphan list. Threads that retire adopt orphans old
+/// enough to be freed, so garbage of exited threads doesn`t wait for domain
+/// destruction.
+///
+/// Has the same interface as \c hazard_pointers, lock-free containers take
+/// either of them as reclamation policy.
+///
+/// \tparam Threshold - limbo list size that triggers attempt to advance epoch.
+template<typename T, size_t Threshold = 64>
+class epoch_domain
+{
+    typedef detail::epoch_record record;
+
+    epoch_domain(const epoch_domain&);
+    epoch_domain& operator=(const epoch_domain&);
+
+public:
+    template<typename U>
+    struct rebind
+    {
+        typedef epoch_domain<U, Threshold> other;
+    };
+
+    epoch_domain()
+        : epoch_(1)
+        , orphans_(0)
+        , records_(&epoch_domain::on_thread_exit, this)
+    {
+    }
+
+    ~epoch_domain()
+    {
+        for (record* r = records_.head(); r; r = r->next_)
+        {
+            assert("Ensure that there are no threads inside guard" && 0 == r->nesting_);
+
+            for (unsigned i = 0; i < record::limbo_count; ++i)
+                dispose(r->limbo_[i]);
+        }
+
+        orphans* o = orphans_.load(boost::memory_order_acquire);
+        while (o)
+        {
+            dispose(o->limbo_);
+
+            orphans* next = o->next_;
+            delete o;
+            o = next;
+        }
+    }
+
+    /// \brief Keep current thread in epoch for scope, so that no node
+    /// retired meanwhile is freed. Guards can be nested.
+    class guard
+    {
+    public:
+        explicit guard(epoch_domain& domain)
+            : domain_(domain)
+            , record_(domain.enter())
+        {
+        }
+
+        ~guard()
+        {
+            domain_.leave(record_);
+        }
+
+        /// Pointer loaded inside guard is safe to dereference until guard ends
+        T* protect(const boost::atomic<T*>& src)
+        {
+            return src.load(boost::memory_order_acquire);
+        }
+
+    private:
+        guard(const guard&);
+        guard& operator=(const guard&);
+
+        epoch_domain& domain_;
+        record& record_;
+    };
+
+    /// \brief Put node that is no longer reachable to limbo list of current
+    /// epoch. It will be destroyed with allocator three epochs later.
+    template<typename Allocator>
+    void reclaim_later(T* ptr, Allocator& allocator)
+    {
+        record& r = enter();
+
+        const unsigned epoch = r.announce_.load(boost::memory_order_relaxed) >> 1;
+        const unsigned i = epoch % record::limbo_count;
+
+        // Limbo list still holds nodes from three epochs ago, they are safe
+        if (r.limbo_epoch_[i] != epoch)
+        {
+            stats_.scan(r.limbo_[i].size());
+            dispose(r.limbo_[i]);
+            r.limbo_epoch_[i] = epoch;
+        }
+
+        r.limbo_[i].push_back(hazard_pointers_reclaim_node(ptr, allocator));
+        stats_.retired(r.limbo_[i].size());
+
+        if (r.limbo_[i].size() >= Threshold)
+            try_advance(epoch);
+
+        if (orphans_.load(boost::memory_order_relaxed))
+            adopt_orphans();
+
+        leave(r);
+    }
+
+    /// \brief Limbo lists recycled, nodes freed by that and limbo list
+    /// high-water mark, zeros unless built with TCL_STATISTICS.
+    statistics get_statistics() const
+    {
+        return stats_.get();
+    }
+
+private:
+    /// Limbo list left by exited thread
+    struct orphans
+    {
+        hazard_pointers_reclaim_list limbo_;
+        unsigned epoch_;
+        orphans* next_;
+    };
+
+    /// Nodes retired in epoch can`t be reached once global epoch is three ahead
+    bool safe(unsigned epoch) const
+    {
+        return epoch_.load(boost::memory_order_acquire) - epoch >= 3;
+    }
+
+    record& enter()
+    {
+        record& r = records_.local();
+        if (r.nesting_++)
+            return r;
+
+        unsigned epoch = epoch_.load(boost::memory_order_relaxed);
+        for(;;)
+        {
+            r.announce_.store((epoch << 1) | 1, boost::memory_order_relaxed);
+            boost::atomic_thread_fence(boost::memory_order_seq_cst);
+
+            const unsigned actual = epoch_.load(boost::memory_order_relaxed);
+            if (actual == epoch)
+                return r;
+
+            epoch = actual;
+        }
+    }
+
+    void leave(record& r)
+    {
+        if (!--r.nesting_)
+            r.announce_.store(0, boost::memory_order_release);
+    }
+
+    void try_advance(unsigned epoch)
+    {
+        const unsigned announce = (epoch << 1) | 1;
+
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        for (record* r = records_.head(); r; r = r->next_)
+        {
+            const unsigned a = r->announce_.load(boost::memory_order_relaxed);
+            if (a && a != announce)
+                return;
+        }
+
+        epoch_.compare_exchange_strong(
+            epoch, epoch + 1, boost::memory_order_acq_rel, boost::memory_order_relaxed);
+    }
+
+    /// Free orphans that are safe, put the rest back
+    void adopt_orphans()
+    {
+        // Take whole list at once, so there is no ABA
+        orphans* o = orphans_.exchange(0, boost::memory_order_acquire);
+        while (o)
+        {
+            orphans* next = o->next_;
+            if (safe(o->epoch_))
+            {
+                stats_.scan(o->limbo_.size());
+                dispose(o->limbo_);
+                delete o;
+            }
+            else
+            {
+                push_orphan(o);
+            }
+
+            o = next;
+        }
+    }
+
+    void push_orphan(orphans* o)
+    {
+        o->next_ = orphans_.load(boost::memory_order_relaxed);
+        while (!orphans_.compare_exchange_weak(o->next_, o, boost::memory_order_release, boost::memory_order_relaxed));
+    }
+
+    static void on_thread_exit(record& r, void* self)
+    {
+        epoch_domain& domain = *static_cast<epoch_domain*>(self);
+
+        for (unsigned i = 0; i < record::limbo_count; ++i)
+        {
+            if (r.limbo_[i].empty())
+                continue;
+
+            if (domain.safe(r.limbo_epoch_[i]))
+            {
+                domain.stats_.scan(r.limbo_[i].size());
+                dispose(r.limbo_[i]);
+                continue;
+            }
+
+            orphans* o = new orphans;
+            o->limbo_.swap(r.limbo_[i]);
+            o->epoch_ = r.limbo_epoch_[i];
+            domain.push_orphan(o);
+        }
+    }
+
+    static void dispose(hazard_pointers_reclaim_list& l)
+    {
+        for (hazard_pointers_reclaim_list::iterator it = l.begin(); it != l.end(); ++it)
+            it->dispose();
+
+        l.clear();
+    }
+
+    boost::atomic<unsigned> epoch_;
+    boost::atomic<orphans*> orphans_;
+    statistics_counters stats_;
+    detail::thread_record_list<record> records_;
+};
+
+}}
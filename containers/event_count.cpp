@@ -0,0 +1,78 @@
+#include "event_count.hpp"
+
+#include <boost/static_assert.hpp>
+
+#include <climits>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+namespace tcl { namespace containers {
+
+#if defined(__linux__)
+
+BOOST_STATIC_ASSERT_MSG(
+    sizeof(boost::atomic<event_count::key_type>) == sizeof(int), "epoch_ is used as futex word");
+
+bool event_count::wait(key_type key, const clock_type::time_point* deadline)
+{
+    timespec ts;
+    timespec* timeout = 0;
+
+    if (deadline)
+    {
+        const clock_type::duration left = *deadline - clock_type::now();
+        if (left <= clock_type::duration::zero())
+            return false;
+
+        const boost::chrono::nanoseconds ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(left);
+        ts.tv_sec = static_cast<time_t>(ns.count() / 1000000000);
+        ts.tv_nsec = static_cast<long>(ns.count() % 1000000000);
+        timeout = &ts;
+    }
+
+    // Return immediately with EAGAIN if epoch_ already differs from key
+    syscall(SYS_futex, reinterpret_cast<int*>(&epoch_), FUTEX_WAIT_PRIVATE, key, timeout, 0, 0);
+
+    return !deadline || clock_type::now() < *deadline;
+}
+
+void event_count::wake(bool all)
+{
+    syscall(SYS_futex, reinterpret_cast<int*>(&epoch_), FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, 0, 0, 0);
+}
+
+#else
+
+bool event_count::wait(key_type key, const clock_type::time_point* deadline)
+{
+    boost::mutex::scoped_lock l(guard_);
+    while (epoch_.load(boost::memory_order_acquire) == key)
+    {
+        if (!deadline)
+            cond_.wait(l);
+        else if (boost::cv_status::timeout == cond_.wait_until(l, *deadline))
+            return epoch_.load(boost::memory_order_acquire) != key;
+    }
+
+    return true;
+}
+
+void event_count::wake(bool all)
+{
+    // Waiter checks epoch_ under lock, taking it here guarantees that
+    // waiter is either already sleeping or will see new epoch_.
+    boost::mutex::scoped_lock l(guard_);
+    if (all)
+        cond_.notify_all();
+    else
+        cond_.notify_one();
+}
+
+#endif
+
+}}
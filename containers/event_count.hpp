@@ -0,0 +1,115 @@
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/cstdint.hpp>
+
+#if !defined(__linux__)
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#endif
+
+namespace tcl { namespace containers {
+
+/// \brief Lets consumer sleep until producer signals that something has changed.
+///
+/// Consumer calls \c prepare_wait, rechecks its condition and then either
+/// \c cancel_wait or \c commit_wait with key returned from \c prepare_wait.
+/// Producer changes state and calls \c notify_one or \c notify_all. Producer
+/// issues wake up only if there is somebody in between \c prepare_wait and
+/// \c commit_wait, otherwise notify costs one fence and one load.
+///
+/// On Linux waiters are parked on futex, elsewhere on condition variable.
+/// See http://www.1024cores.net/home/lock-free-algorithms/eventcounts
+class event_count
+{
+    event_count(const event_count&);
+    event_count& operator=(const event_count&);
+
+public:
+    typedef boost::uint32_t key_type;
+    typedef boost::chrono::steady_clock clock_type;
+
+    event_count();
+
+    key_type prepare_wait();
+    void cancel_wait();
+
+    /// Sleep until notify was called after \c prepare_wait returned key.
+    /// Spurious wake ups are possible.
+    void commit_wait(key_type key);
+
+    /// Same as \c commit_wait, but don`t sleep past deadline.
+    /// Return false if deadline has passed.
+    bool commit_wait_until(key_type key, const clock_type::time_point& deadline);
+
+    void notify_one();
+    void notify_all();
+
+private:
+    void notify(bool all);
+    bool wait(key_type key, const clock_type::time_point* deadline);
+    void wake(bool all);
+
+    boost::atomic<key_type> epoch_;     //!< Futex word, changed by every notify with waiters
+    boost::atomic<key_type> waiters_;   //!< Number of threads between prepare and commit
+
+#if !defined(__linux__)
+    boost::mutex guard_;
+    boost::condition_variable cond_;
+#endif
+};
+
+inline event_count::event_count()
+    : epoch_(0)
+    , waiters_(0)
+{
+}
+
+inline auto event_count::prepare_wait() -> key_type
+{
+    waiters_.fetch_add(1, boost::memory_order_seq_cst);
+    return epoch_.load(boost::memory_order_acquire);
+}
+
+inline void event_count::cancel_wait()
+{
+    waiters_.fetch_sub(1, boost::memory_order_relaxed);
+}
+
+inline void event_count::commit_wait(key_type key)
+{
+    wait(key, 0);
+    waiters_.fetch_sub(1, boost::memory_order_relaxed);
+}
+
+inline bool event_count::commit_wait_until(key_type key, const clock_type::time_point& deadline)
+{
+    const bool res = wait(key, &deadline);
+    waiters_.fetch_sub(1, boost::memory_order_relaxed);
+    return res;
+}
+
+inline void event_count::notify_one()
+{
+    notify(false);
+}
+
+inline void event_count::notify_all()
+{
+    notify(true);
+}
+
+inline void event_count::notify(bool all)
+{
+    // Pairs with fetch_add in prepare_wait: either we see waiter here,
+    // or waiter sees state that was changed before notify.
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (!waiters_.load(boost::memory_order_relaxed))
+        return;
+
+    epoch_.fetch_add(1, boost::memory_order_release);
+    wake(all);
+}
+
+}}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "cpu_relax.hpp"
+#include "event_count.hpp"
+#include "thread_record_cache.hpp"
+
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+
+#include <exception>
+#include <queue>
+#include <stack>
+
+namespace tcl { namespace containers {
+
+namespace detail {
+
+template<typename T>
+T& fc_peek(std::stack<T>& s)
+{
+    return s.top();
+}
+
+template<typename T>
+T& fc_peek(std::queue<T>& q)
+{
+    return q.front();
+}
+
+/// Operation published by thread, one per thread per container
+template<typename T>
+struct fc_record
+{
+    enum
+    {
+        none,
+        push_op,
+        pop_op
+    };
+
+    fc_record()
+        : request_(none)
+        , in_(0)
+        , out_(0)
+        , success_(false)
+        , in_use_(false)
+        , next_(0)
+    {}
+
+    boost::atomic<int> request_;
+    const T* in_;
+    T* out_;
+    bool success_;
+    std::exception_ptr error_;
+
+    boost::atomic<bool> in_use_;
+    fc_record* next_;
+
+    char pad_[cache_line_size];
+};
+
+}
+
+/// \brief Flat combining adapter for sequential std::stack or std::queue.
+///
+/// Thread publishes its operation in own record and tries to take the lock.
+/// Winner becomes combiner and applies all published operations in one pass,
+/// so sequence and lock stay in combiner`s cache; other threads just wait
+/// until their requests are served. See "Flat Combining and the
+/// Synchronization-Parallelism Tradeoff" by Hendler, Incze, Shavit and Tzafrir.
+///
+/// Records are owned by container, see \c thread_record_list.
+///
+/// Waiter spins for a while and then parks on \c event_count, combiner wakes
+/// parked waiters after it has served them and released the lock.
+///
+/// Exception thrown by operation is rethrown in the thread that requested it.
+template<typename Sequence>
+class flat_combining
+{
+    typedef typename Sequence::value_type value_type;
+    typedef detail::fc_record<value_type> record;
+
+    /// Spin iterations before waiter parks
+    static const unsigned spin_count = 64;
+
+    flat_combining(const flat_combining&);
+    flat_combining& operator=(const flat_combining&);
+
+public:
+    flat_combining()
+        : locked_(false)
+    {
+    }
+
+    void push(const value_type& value)
+    {
+        record& r = records_.local();
+        r.in_ = &value;
+        execute(r, record::push_op);
+    }
+
+    bool try_pop(value_type& result)
+    {
+        record& r = records_.local();
+        r.out_ = &result;
+        execute(r, record::pop_op);
+        return r.success_;
+    }
+
+private:
+    void execute(record& r, int op)
+    {
+        r.request_.store(op, boost::memory_order_release);
+
+        for(;;)
+        {
+            if (!locked_.load(boost::memory_order_relaxed) &&
+                !locked_.exchange(true, boost::memory_order_acquire))
+            {
+                // Own request is published, so combiner serves it too
+                combine();
+                locked_.store(false, boost::memory_order_release);
+                served_.notify_all();
+                break;
+            }
+
+            wait_combiner(r);
+
+            if (r.request_.load(boost::memory_order_acquire) == record::none)
+                break;
+        }
+
+        if (r.error_)
+        {
+            std::exception_ptr error = r.error_;
+            r.error_ = std::exception_ptr();
+            std::rethrow_exception(error);
+        }
+    }
+
+    /// Wait until combiner serves request or leaves without it
+    void wait_combiner(const record& r)
+    {
+        for (unsigned i = 0; i < spin_count; ++i)
+        {
+            if (!waiting(r))
+                return;
+
+            detail::cpu_relax();
+        }
+
+        for(;;)
+        {
+            const event_count::key_type key = served_.prepare_wait();
+            if (!waiting(r))
+            {
+                served_.cancel_wait();
+                return;
+            }
+
+            served_.commit_wait(key);
+        }
+    }
+
+    bool waiting(const record& r) const
+    {
+        return r.request_.load(boost::memory_order_acquire) != record::none
+            && locked_.load(boost::memory_order_relaxed);
+    }
+
+    void combine()
+    {
+        for (record* r = records_.head(); r; r = r->next_)
+        {
+            const int op = r->request_.load(boost::memory_order_acquire);
+            if (op == record::none)
+                continue;
+
+            try
+            {
+                if (op == record::push_op)
+                {
+                    sequence_.push(*r->in_);
+                    r->success_ = true;
+                }
+                else if (sequence_.empty())
+                {
+                    r->success_ = false;
+                }
+                else
+                {
+                    *r->out_ = std::move(detail::fc_peek(sequence_));
+                    sequence_.pop();
+                    r->success_ = true;
+                }
+            }
+            catch(...)
+            {
+                r->error_ = std::current_exception();
+            }
+
+            r->request_.store(record::none, boost::memory_order_release);
+        }
+    }
+
+    // Touched only by combiner
+    Sequence sequence_;
+    char pad0_[cache_line_size];
+
+    // Spun on by waiters
+    boost::atomic<bool> locked_;
+    char pad1_[cache_line_size];
+
+    // Parked waiters
+    event_count served_;
+    char pad2_[cache_line_size];
+
+    detail::thread_record_list<record> records_;
+};
+
+/// \brief Flat combining stack, compare with lb_stack and lock-free stacks
+template<typename T>
+class fc_stack : public flat_combining<std::stack<T> >
+{
+};
+
+/// \brief Flat combining queue, compare with lb_queue and lock-free queues
+template<typename T>
+class fc_queue : public flat_combining<std::queue<T> >
+{
+};
+
+}}
@@ -1,44 +1,124 @@
 #pragma once
 
+#include "asymmetric_fence.hpp"
 #include "hazard_pointers_reclaim_list.hpp"
+#include "lf_mpmc_ring.hpp"
+#include "waitable_queue.hpp"
+#include "thread_record_cache.hpp"
+
+#include <tcl/cache_line.hpp>
+#include <tcl/statistics.hpp>
 
 #include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/thread/thread.hpp>
 
+#include <algorithm>
 #include <stdexcept>
 #include <cassert>
-
-#include <windows.h>
+#include <vector>
 
 namespace tcl { namespace containers {
 
 /// \brief Container of hazard pointers.
 ///
+/// Each thread gets its own record with \c Size hazard pointers when it uses
+/// domain for the first time. Record is cached per thread, so acquiring hazard
+/// pointer is a bit scan in thread private mask and marking pointer as hazard
+/// is plain store. Records are kept in lock-free list that grows when new
+/// threads come, so number of threads is not limited.
+///
+/// Retired pointers are kept in record of thread that retired them. When
+/// there are enough of them, thread takes snapshot of all hazard pointers,
+/// sorts it and frees every retired pointer that is not found in snapshot.
+/// So scan costs O((R + H) log H) rather than O(R * H). Whatever is left is
+/// freed in destructor.
+///
+/// When thread exits, it scans its retired pointers one last time and pushes
+/// the rest to domain`s orphan list, its record is taken by next new thread.
+/// Survivors adopt orphans on their next scan, so garbage of exited threads
+/// doesn`t wait for domain destruction. Outstanding garbage can be bounded
+/// with \c set_max_outstanding.
+///
+/// In background mode domain starts its own reclaimer thread. Retiring
+/// pointer is then single push to bounded queue, reclaimer drains it, scans
+/// and frees. If reclaimer falls behind and queue is full, retiring threads
+/// go back to scanning their own lists until it catches up.
+///
 /// More on hazard pointers http://drdobbs.com/cpp/184401890
-template<typename T, size_t Size>
+///
+/// \tparam Size - number of hazard pointers one thread can hold at once.
+/// \tparam AsymmetricFence - publish hazard pointer with \c asymmetric_fence::light
+///                           and scan after \c asymmetric_fence::heavy, so readers
+///                           pay no fence when system supports it.
+/// \tparam BackgroundReclaim - scan and free on dedicated reclaimer thread.
+template<typename T, size_t Size, bool AsymmetricFence = false, bool BackgroundReclaim = false>
 class hazard_pointers
 {
-	struct context
+	BOOST_STATIC_ASSERT_MSG(Size > 0 && Size <= 32, "Size must be in [1, 32]");
+
+	struct record
 	{
-		context() : id_(0), ptr_(0) {}
+		record()
+			: in_use_(false)
+			, next_(0)
+			, used_(0)
+			, retired_count_(0)
+			, handed_off_(0)
+		{
+			for (size_t i=0; i<Size; ++i)
+				hps_[i].store(0, boost::memory_order_relaxed);
+		}
 
-		boost::atomic<unsigned> id_; 			//!< Thread that owns hazard pointer
-		boost::atomic<const T*> ptr_;			//!< Pointer value
+		char pad0_[cache_line_size];
+
+		// Read by scanning threads. Hazard pointers of one record have single
+		// writer, so they are packed together and scan reads as few lines as
+		// possible, but owner bookkeeping lives on other lines.
+		boost::atomic<const T*> hps_[Size];	//!< Hazard pointers
+		boost::atomic<bool> in_use_;
+		record* next_;
+		char pad1_[cache_line_size];
+
+		// Written by owner on every context and retire
+		unsigned used_;							//!< Mask of hazard pointers in use, touched only by owner
+		hazard_pointers_reclaim_list retired_;	//!< Retired by owner, not freed yet
+		std::vector<const T*> snapshot_;		//!< Scratch space for scan, reused
+		boost::atomic<size_t> retired_count_;	//!< Size of retired_ for \c outstanding
+		boost::atomic<size_t> handed_off_;		//!< Pushed to reclaimer queue, ever
+		char pad2_[cache_line_size];
+	};
 
-    private:
-		context(const context&);
-		context& operator=(const context&);
+	/// Retired pointers left by exited thread
+	struct orphans
+	{
+		hazard_pointers_reclaim_list retired_;
+		orphans* next_;
 	};
 
-	static const size_t delete_threashold_size = Size * 2;
+	static const size_t reclaimer_queue_size = 1024;
+
+	/// Reclaimer rescans protected leftovers after being idle for that long
+	static const unsigned reclaimer_retry_ms = 1;
+
+	typedef waitable_queue<lf_mpmc_ring<hazard_pointers_reclaim_node, reclaimer_queue_size> > reclaim_queue;
 
 	hazard_pointers(const hazard_pointers&);
 	hazard_pointers& operator=(const hazard_pointers&);
 
 public:
+	template<typename U>
+	struct rebind
+	{
+		typedef hazard_pointers<U, Size, AsymmetricFence, BackgroundReclaim> other;
+	};
+
 	hazard_pointers();
 	~hazard_pointers();
 
-	/// \brief Find free hazard pointer and allocate it for scope.
+	/// \brief Take free hazard pointer of current thread for scope.
 	class scoped_allocator
 	{
 	public:
@@ -51,40 +131,90 @@ public:
 
 		boost::atomic<const T*>& ref();
 
+		/// Load pointer from src and mark it as hazard. Repeat until src
+		/// stays the same, so returned pointer is safe to dereference.
+		T* protect(const boost::atomic<T*>& src);
+
+		/// Mark pointer as hazard. It is safe to dereference only if caller
+		/// checks afterwards that pointer is still reachable.
+		void set(const T* ptr);
+
 	private:
 		scoped_allocator(const scoped_allocator&);
 		scoped_allocator& operator=(const scoped_allocator&);
 
-		context* ctx_;
+		record* record_;
+		unsigned index_;
 	};
 
+	/// Common name for reclamation policies, see \c epoch_domain
+	typedef scoped_allocator guard;
+
     /// \brief Return true if this pointer is marked as hazard by another thread
 	bool outstanding_hp_for(const T* ptr) const;
 
     /// \brief Push pointer together with allocater to reclaim later list.
-    /// When reclaim list grows to some threashold size, it will be searched for 
-    /// pointers that are ready to delete and delete them using allocator.deallocate
-    /// method
+    /// When reclaim list grows to some threashold size, it will be searched for
+    /// pointers that are ready to delete and delete them using allocators::destroy.
+    /// Allocator must outlive this object.
     template<typename Allocator>
 	void reclaim_later(T* ptr, Allocator& allocator);
 
+	/// \brief Bound retired pointers that are not freed yet by \c max.
+	/// Each thread gets a share of it, \c max divided by number of threads,
+	/// and scans as soon as its own list together with lists left by exited
+	/// threads reaches the share, scan adopts the latter. So total stays
+	/// within \c max, except pointers still marked as hazard, which can`t be
+	/// freed: up to \c Size per thread may stay above the bound.
+	/// 0 means no bound.
+	void set_max_outstanding(size_t max);
+	size_t max_outstanding() const;
+
+	/// \brief Number of retired pointers that are not freed yet, approximate
+	/// while other threads retire.
+	size_t outstanding() const;
+
+	/// \brief Scans, nodes freed by them and reclaim list high-water mark,
+	/// zeros unless built with TCL_STATISTICS.
+	statistics get_statistics() const;
+
 private:
-	context hps_[Size];
+	size_t scan_threshold() const;
+	bool should_scan(const record& r) const;
+	void scan(record& r);
+	void adopt_orphans(record& r);
+	void reclaimer_proc();
+
+	static void on_thread_exit(record& r, void* self);
+
+	boost::atomic<size_t> max_outstanding_;
+	boost::atomic<orphans*> orphans_;
+	boost::atomic<size_t> orphaned_count_;
+
+	boost::scoped_ptr<reclaim_queue> queue_;
+	char pad0_[cache_line_size];
+
+	// Written by reclaimer, keep it apart from queue_ read by every retire
+	boost::atomic<size_t> drained_;			//!< Popped from queue_ by reclaimer, ever
+	char pad1_[cache_line_size];
+
+	boost::thread reclaimer_;
+
+	statistics_counters stats_;
+	detail::thread_record_list<record> records_;
 };
 
-template<typename T, size_t Size>
-hazard_pointers<T, Size>::scoped_allocator::scoped_allocator(hazard_pointers& hps)
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::scoped_allocator::scoped_allocator(hazard_pointers& hps)
+	: record_(&hps.records_.local())
 {
-	for(size_t i=0; i<Size; ++i)
+	for(unsigned i=0; i<Size; ++i)
 	{
-        context& ctx = hps.hps_[i];
-		unsigned null_id = 0;
-
-		if (ctx.id_.compare_exchange_strong(
-				null_id, GetCurrentThreadId(), boost::memory_order_acq_rel, boost::memory_order_relaxed)
-			)
+		const unsigned bit = 1u << i;
+		if (!(record_->used_ & bit))
 		{
-			ctx_ = &ctx;
+			record_->used_ |= bit;
+			index_ = i;
 			return;
 		}
 	}
@@ -92,83 +222,334 @@ hazard_pointers<T, Size>::scoped_allocator::scoped_allocator(hazard_pointers& hp
 	throw std::runtime_error("no free hazard pointers");
 }
 
-template<typename T, size_t Size>
-hazard_pointers<T, Size>::scoped_allocator::~scoped_allocator()
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::scoped_allocator::scoped_allocator(scoped_allocator&& other)
+	: record_(other.record_)
+	, index_(other.index_)
 {
-	ctx_->ptr_.store(0, boost::memory_order_relaxed);
-	ctx_->id_.store(0, boost::memory_order_release);
+	other.record_ = 0;
 }
 
-template<typename T, size_t Size>
-boost::atomic<const T*>& hazard_pointers<T, Size>::scoped_allocator::ref()
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+auto hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::scoped_allocator::operator=(scoped_allocator&& other) -> scoped_allocator&
 {
-	return ctx_->ptr_;
+	if (this != &other)
+	{
+		this->~scoped_allocator();
+		record_ = other.record_;
+		index_ = other.index_;
+		other.record_ = 0;
+	}
+
+	return *this;
 }
 
-template<typename T, size_t Size>
-hazard_pointers<T, Size>::hazard_pointers()
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::scoped_allocator::~scoped_allocator()
 {
+	if (!record_)
+		return;
+
+	record_->hps_[index_].store(0, boost::memory_order_release);
+	record_->used_ &= ~(1u << index_);
 }
 
-template<typename T, size_t Size>
-hazard_pointers<T, Size>::~hazard_pointers()
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+boost::atomic<const T*>& hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::scoped_allocator::ref()
 {
-	// Just assert that there are no hazard pointers in use
-	for (size_t i=0; i<Size; ++i)
+	return record_->hps_[index_];
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+T* hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::scoped_allocator::protect(const boost::atomic<T*>& src)
+{
+	T* ptr = src.load(boost::memory_order_relaxed);
+	for(;;)
+	{
+		set(ptr);
+
+		T* actual = src.load(boost::memory_order_acquire);
+		if (actual == ptr)
+			return ptr;
+
+		ptr = actual;
+	}
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+void hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::scoped_allocator::set(const T* ptr)
+{
+	boost::atomic<const T*>& hp = record_->hps_[index_];
+
+	if (AsymmetricFence)
+	{
+		hp.store(ptr, boost::memory_order_relaxed);
+		asymmetric_fence::light();
+	}
+	else
+		hp.store(ptr, boost::memory_order_seq_cst);
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::hazard_pointers()
+	: max_outstanding_(0)
+	, orphans_(0)
+	, orphaned_count_(0)
+	, queue_(BackgroundReclaim ? new reclaim_queue : 0)
+	, drained_(0)
+	, records_(&hazard_pointers::on_thread_exit, this)
+{
+	if (BackgroundReclaim)
+		reclaimer_ = boost::thread(&hazard_pointers::reclaimer_proc, this);
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::~hazard_pointers()
+{
+	if (BackgroundReclaim)
+	{
+		// Null pointer tells reclaimer to stop, it is the last one in queue
+		queue_->push(hazard_pointers_reclaim_node(static_cast<T*>(0)));
+		reclaimer_.join();
+	}
+
+	// Exiting threads must not touch records while they are torn down
+	records_.close();
+
+	for (record* r = records_.head(); r; r = r->next_)
 	{
-        context& ctx = hps_[i];
 		assert(
 			"Ensure that there are no hazard pointers in use" &&
-			0 == ctx.id_.load(boost::memory_order_relaxed));
+			0 == r->used_);
+
+		for (auto it = r->retired_.begin(); it != r->retired_.end(); ++it)
+			it->dispose();
+	}
+
+	orphans* o = orphans_.load(boost::memory_order_acquire);
+	while (o)
+	{
+		for (auto it = o->retired_.begin(); it != o->retired_.end(); ++it)
+			it->dispose();
+
+		orphans* next = o->next_;
+		delete o;
+		o = next;
 	}
 }
 
-template<typename T, size_t Size>
-bool hazard_pointers<T, Size>::outstanding_hp_for(const T* ptr) const
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+bool hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::outstanding_hp_for(const T* ptr) const
 {
-	for (size_t i=0; i<Size; ++i)
+	for (const record* r = records_.head(); r; r = r->next_)
 	{
-        const context& ctx = hps_[i];
-		if (0 != ctx.id_.load() && ctx.ptr_ == ptr)
-			return true;
+		for (size_t i=0; i<Size; ++i)
+		{
+			if (r->hps_[i].load(boost::memory_order_acquire) == ptr)
+				return true;
+		}
 	}
 
 	return false;
 }
 
-template<typename T, size_t Size>
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
 template<typename Allocator>
-void hazard_pointers<T, Size>::reclaim_later(T* ptr, Allocator& allocator)
+void hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::reclaim_later(T* ptr, Allocator& allocator)
 {
-	auto& rl = get_reclaim_list();
+	record& r = records_.local();
+	const hazard_pointers_reclaim_node node(ptr, allocator);
 
-	rl.push_back(
-        hazard_pointers_reclaim_node(
-            ptr
-          , [allocator](void* ptr) -> void 
-            {   
-                const_cast<Allocator&>(allocator).deallocate(static_cast<T*>(ptr), 1);
-            }
-          ) 
-      );
-
-	if (rl.size() < delete_threashold_size)
+	// When queue is full, reclaimer is behind, so scan inline until it catches up
+	if (BackgroundReclaim && queue_->try_push(node))
+	{
+		r.handed_off_.store(r.handed_off_.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
 		return;
+	}
+
+	r.retired_.push_back(node);
+	r.retired_count_.store(r.retired_.size(), boost::memory_order_relaxed);
+	stats_.retired(r.retired_.size());
+
+	if (should_scan(r))
+		scan(r);
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+size_t hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::scan_threshold() const
+{
+	// Scan is amortized over number of hazard pointers, that may be set.
+	// With bound set, each thread keeps no more than its share of it.
+	const size_t threads = records_.size();
+	size_t threshold = 2 * Size * threads;
+
+	if (const size_t max = max_outstanding_.load(boost::memory_order_relaxed))
+		threshold = (std::min)(threshold, (std::max)(max / threads, size_t(1)));
+
+	return threshold;
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+bool hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::should_scan(const record& r) const
+{
+	// Leftovers of exited threads are adopted by scan, count them in, so
+	// they don`t stay above the bound until some list grows by itself
+	return r.retired_.size() + orphaned_count_.load(boost::memory_order_relaxed) >= scan_threshold();
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+void hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::set_max_outstanding(size_t max)
+{
+	max_outstanding_.store(max, boost::memory_order_relaxed);
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+size_t hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::max_outstanding() const
+{
+	return max_outstanding_.load(boost::memory_order_relaxed);
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+size_t hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::outstanding() const
+{
+	size_t result = orphaned_count_.load(boost::memory_order_relaxed);
+	size_t handed_off = 0;
+	for (const record* r = records_.head(); r; r = r->next_)
+	{
+		result += r->retired_count_.load(boost::memory_order_relaxed);
+		handed_off += r->handed_off_.load(boost::memory_order_relaxed);
+	}
+
+	// Reclaimer may have drained what we haven`t counted yet
+	const size_t drained = drained_.load(boost::memory_order_relaxed);
+	if (handed_off > drained)
+		result += handed_off - drained;
+
+	return result;
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+statistics hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::get_statistics() const
+{
+	return stats_.get();
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+void hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::scan(record& r)
+{
+	if (orphans_.load(boost::memory_order_relaxed))
+		adopt_orphans(r);
+
+	// Pairs with fence in protect
+	if (AsymmetricFence)
+		asymmetric_fence::heavy();
+	else
+		boost::atomic_thread_fence(boost::memory_order_seq_cst);
+
+	r.snapshot_.clear();
+	for (const record* other = records_.head(); other; other = other->next_)
+	{
+		for (size_t i=0; i<Size; ++i)
+		{
+			if (const T* hp = other->hps_[i].load(boost::memory_order_relaxed))
+				r.snapshot_.push_back(hp);
+		}
+	}
 
-	auto b = rl.begin();
-	auto e = rl.end();
+	std::sort(r.snapshot_.begin(), r.snapshot_.end());
+
+	auto b = r.retired_.begin();
+	auto e = r.retired_.end();
 	while (b != e)
 	{
-		if (outstanding_hp_for(b->ptr<T>()))
+		if (std::binary_search(r.snapshot_.begin(), r.snapshot_.end(), b->template ptr<T>()))
 			++b;
 		else
 		{
 			b->dispose();
-			*b = std::move(*--e);
+			*b = *--e;
 		}
 	}
 
-	rl.erase(e, rl.end());
+	stats_.scan(r.retired_.end() - e);
+	r.retired_.erase(e, r.retired_.end());
+	r.retired_count_.store(r.retired_.size(), boost::memory_order_relaxed);
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+void hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::adopt_orphans(record& r)
+{
+	// Take whole list at once, so there is no ABA
+	orphans* o = orphans_.exchange(0, boost::memory_order_acquire);
+	while (o)
+	{
+		r.retired_.insert(r.retired_.end(), o->retired_.begin(), o->retired_.end());
+		orphaned_count_.fetch_sub(o->retired_.size(), boost::memory_order_relaxed);
+
+		orphans* next = o->next_;
+		delete o;
+		o = next;
+	}
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+void hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::on_thread_exit(record& r, void* self)
+{
+	hazard_pointers& hps = *static_cast<hazard_pointers*>(self);
+
+	if (!r.retired_.empty())
+		hps.scan(r);
+
+	if (r.retired_.empty())
+		return;
+
+	orphans* o = new orphans;
+	o->retired_.swap(r.retired_);
+	r.retired_count_.store(0, boost::memory_order_relaxed);
+	hps.orphaned_count_.fetch_add(o->retired_.size(), boost::memory_order_relaxed);
+
+	o->next_ = hps.orphans_.load(boost::memory_order_relaxed);
+	while (!hps.orphans_.compare_exchange_weak(o->next_, o, boost::memory_order_release, boost::memory_order_relaxed));
+}
+
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+void hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>::reclaimer_proc()
+{
+	record& r = records_.local();
+	const boost::chrono::milliseconds retry(reclaimer_retry_ms);
+
+	for(;;)
+	{
+		hazard_pointers_reclaim_node node(static_cast<T*>(0));
+
+		// Protected leftovers are rescanned once nothing comes for a while
+		if (r.retired_.empty())
+			queue_->wait_pop(node);
+		else if (!queue_->wait_pop_for(node, retry))
+		{
+			scan(r);
+			continue;
+		}
+
+		size_t drained = 0;
+		do
+		{
+			if (!node.template ptr<T>())
+				return;
+
+			r.retired_.push_back(node);
+			++drained;
+		}
+		while (queue_->try_pop(node));
+
+		// Count before retired_count_, so outstanding doesn`t see nodes twice
+		drained_.fetch_add(drained, boost::memory_order_relaxed);
+		r.retired_count_.store(r.retired_.size(), boost::memory_order_relaxed);
+		stats_.retired(r.retired_.size());
+
+		if (should_scan(r))
+			scan(r);
+	}
 }
 
 }}
@@ -1,46 +1,35 @@
 #pragma once
 
-#include <boost/atomic.hpp>
+#include <tcl/allocators/construct_destroy.hpp>
 
-#include <functional>
 #include <vector>
 
-/// \todo When thread local become available use it instead
-/// of boost::thread_specific_ptr.
-
 namespace tcl { namespace containers {
 
-/// \brief Pointer to object tied together with polimorphic deleter 
+/// \brief Pointer to object tied together with deleter and its context.
+///
+/// Fixed size and trivially copyable, so retiring node never allocates
+/// besides growth of reclaim list itself. Allocator is referenced, not copied,
+/// so it must outlive the node; reclamation domains dispose all nodes
+/// in destructor, and they are members of container that owns allocator.
 struct hazard_pointers_reclaim_node
 {
 	template<typename T>
-	hazard_pointers_reclaim_node(T* ptr)
+	explicit hazard_pointers_reclaim_node(T* ptr)
 	: ptr_(ptr)
+	, context_(0)
 	, deleter_(&hazard_pointers_reclaim_node::std_deleter<T>)
 	{
 	}
 
-	template<typename T, typename Deleter>
-	hazard_pointers_reclaim_node(T* ptr, const Deleter& deleter)
+	template<typename T, typename Allocator>
+	hazard_pointers_reclaim_node(T* ptr, Allocator& allocator)
 	: ptr_(ptr)
-	, deleter_(deleter)
+	, context_(&allocator)
+	, deleter_(&hazard_pointers_reclaim_node::allocator_deleter<T, Allocator>)
 	{
 	}
 
-	hazard_pointers_reclaim_node(hazard_pointers_reclaim_node&& other)
-    : ptr_(other.ptr_)
-    , deleter_(std::move(other.deleter_))
-    {
-    }
-
-	hazard_pointers_reclaim_node& operator=(hazard_pointers_reclaim_node&& other)
-    {
-        ptr_ = other.ptr_;
-        deleter_ = std::move(other.deleter_);
-
-        return *this;
-    }
-
 	template<typename T>
 	T* ptr() const
 	{
@@ -49,50 +38,28 @@ struct hazard_pointers_reclaim_node
 
 	void dispose()
 	{
-		deleter_(ptr_);
+		deleter_(ptr_, context_);
 		ptr_ = 0;
 	}
 
-	void swap(hazard_pointers_reclaim_node& n)
-	{
-		std::swap(ptr_, n.ptr_);
-		std::swap(deleter_, n.deleter_);
-	}
-
 private:
-	hazard_pointers_reclaim_node();
-	hazard_pointers_reclaim_node(const hazard_pointers_reclaim_node&);
-	hazard_pointers_reclaim_node& operator=(const hazard_pointers_reclaim_node&);
-
     template<typename T>
-	static void std_deleter(void* ptr)
+	static void std_deleter(void* ptr, void*)
 	{
 		delete static_cast<T*>(ptr);
 	}
 
-	friend bool operator<(hazard_pointers_reclaim_node& n1, hazard_pointers_reclaim_node& n2)
+    template<typename T, typename Allocator>
+	static void allocator_deleter(void* ptr, void* context)
 	{
-		return n1.ptr_ < n2.ptr_;
+		allocators::destroy(*static_cast<Allocator*>(context), static_cast<T*>(ptr));
 	}
 
 	void* ptr_;
-	std::function<void(void*)> deleter_;
+	void* context_;
+	void (*deleter_)(void*, void*);
 };
 
 typedef std::vector<hazard_pointers_reclaim_node> hazard_pointers_reclaim_list;
 
-hazard_pointers_reclaim_list& get_reclaim_list();
-
 }}
-
-namespace std {
-
-template<> inline void swap(
-    tcl::containers::hazard_pointers_reclaim_node& n1
-  , tcl::containers::hazard_pointers_reclaim_node& n2
-  )
-{
-	n1.swap(n2);
-}
-
-}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <tcl/allocators/construct_destroy.hpp>
+#include <tcl/cache_line.hpp>
+
+#include <boost/thread/mutex.hpp>
 
 #include <memory>
 
@@ -71,11 +74,15 @@ private:
         return tail_;
     }
 
+    // Consumers side
     node* head_;
     boost::mutex head_guard_;
+    char pad0_[cache_line_size];
 
+    // Producers side
     node* tail_;
     boost::mutex tail_guard_;
+    char pad1_[cache_line_size];
 };
 
 }}
@@ -1,6 +1,7 @@
-#pragma
+#pragma once
 
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
 #include <queue>
 
 namespace tcl { namespace containers {
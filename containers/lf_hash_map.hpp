@@ -0,0 +1,453 @@
+#pragma once
+
+#include "hazard_pointers.hpp"
+
+#include <tcl/allocators/construct_destroy.hpp>
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace tcl { namespace containers {
+
+namespace detail {
+
+/// Reverse bit order, so that bucket splits in place when table doubles
+inline boost::uint64_t lf_hash_map_reverse(boost::uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+    x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((x & 0x0F0F0F0F0F0F0F0Full) << 4);
+    x = ((x >> 8) & 0x00FF00FF00FF00FFull) | ((x & 0x00FF00FF00FF00FFull) << 8);
+    x = ((x >> 16) & 0x0000FFFF0000FFFFull) | ((x & 0x0000FFFF0000FFFFull) << 16);
+    return (x >> 32) | (x << 32);
+}
+
+/// Index of the highest set bit, x must not be 0
+inline unsigned lf_hash_map_log2(boost::uint64_t x)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(x);
+#else
+    unsigned result = 0;
+    while (x >>= 1)
+        ++result;
+    return result;
+#endif
+}
+
+template<typename Key, typename Value>
+struct lf_hash_map_node
+{
+    typedef std::pair<const Key, Value> value_type;
+
+    /// Dummy node, head of bucket
+    explicit lf_hash_map_node(boost::uint64_t so_key)
+        : so_key_(so_key)
+        , next_(0)
+    {
+    }
+
+    lf_hash_map_node(boost::uint64_t so_key, const Key& key, const Value& value)
+        : so_key_(so_key)
+        , next_(0)
+    {
+        new (&storage_) value_type(key, value);
+    }
+
+    ~lf_hash_map_node()
+    {
+        if (!is_dummy())
+            value()->~value_type();
+    }
+
+    /// Regular nodes have lowest bit of split order key set
+    bool is_dummy() const
+    {
+        return !(so_key_ & 1);
+    }
+
+    value_type* value()
+    {
+        return static_cast<value_type*>(static_cast<void*>(&storage_));
+    }
+
+    const boost::uint64_t so_key_;
+    boost::atomic<lf_hash_map_node*> next_;     //!< Lowest bit set when node is erased
+    typename boost::aligned_storage<sizeof(value_type), boost::alignment_of<value_type>::value>::type storage_;
+};
+
+}
+
+/// \brief Lock-free hash map on split-ordered list.
+///
+/// All nodes are kept in one lock-free sorted list sorted by bit-reversed hash.
+/// Bucket is a pointer to dummy node in that list. When table doubles, bucket
+/// splits in place by inserting one more dummy, so nodes never move and
+/// there are no global locks. Bucket table is array of segments that grow
+/// twice each, segments are allocated on first access and never freed while
+/// map is alive. See "Split-Ordered Lists: Lock-Free Extensible Hash Tables"
+/// by Shalev and Shavit, list itself is "High Performance Dynamic Lock-Free
+/// Hash Tables and List-Based Sets" by Maged Michael.
+///
+/// \c find, \c insert and \c erase are lock-free, \c find only helps to unlink
+/// erased nodes it passes by. Erased nodes are reclaimed through hazard
+/// pointers, operation holds three of them. Values can`t be changed after
+/// insert and \c find returns copy.
+///
+/// \tparam Allocator - allocator for nodes, fixed_allocator fits well.
+/// \tparam Reclamation - hazard_pointers with at least 3 pointers per thread.
+template<
+    typename Key
+  , typename Value
+  , typename Hash = boost::hash<Key>
+  , typename Pred = std::equal_to<Key>
+  , typename Allocator = std::allocator<std::pair<const Key, Value> >
+  , typename Reclamation = hazard_pointers<void, 3>
+  >
+class lf_hash_map : Allocator::template rebind<detail::lf_hash_map_node<Key, Value> >::other
+{
+    typedef detail::lf_hash_map_node<Key, Value> node;
+    typedef typename Allocator::template rebind<node>::other node_allocator;
+
+    typedef boost::atomic<node*> bucket;
+    typedef typename Allocator::template rebind<bucket>::other bucket_allocator;
+
+    typedef typename Reclamation::template rebind<node>::other reclamation_type;
+    typedef typename reclamation_type::guard guard;
+
+    /// Segment 0 has bucket 0, segment k > 0 has buckets [2^(k-1), 2^k)
+    static const size_t segments_count = 64;
+
+    /// Table doubles when there are more nodes than that per bucket
+    static const size_t max_load = 2;
+
+    /// Hazard pointers of one operation and position found by search
+    struct cursor
+    {
+        explicit cursor(reclamation_type& reclamation)
+            : hp0_(reclamation)
+            , hp1_(reclamation)
+            , hp2_(reclamation)
+            , prev_hp_(&hp0_)
+            , cur_hp_(&hp1_)
+            , next_hp_(&hp2_)
+            , prev_(0)
+            , cur_(0)
+            , next_(0)
+        {
+        }
+
+        guard hp0_;
+        guard hp1_;
+        guard hp2_;
+
+        guard* prev_hp_;        //!< Protects node that owns prev_
+        guard* cur_hp_;
+        guard* next_hp_;
+
+        bucket* prev_;          //!< Link to cur_
+        node* cur_;
+        node* next_;
+    };
+
+    lf_hash_map(const lf_hash_map&);
+    lf_hash_map& operator=(const lf_hash_map&);
+
+public:
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<const Key, Value> value_type;
+
+    lf_hash_map(const Hash& hash = Hash(), const Pred& pred = Pred(), const Allocator& allocator = Allocator())
+        : node_allocator(allocator)
+        , hash_(hash)
+        , pred_(pred)
+        , size_(0)
+        , bucket_count_(2)
+    {
+        for (size_t i = 0; i < segments_count; ++i)
+            segments_[i].store(0, boost::memory_order_relaxed);
+
+        node* head = allocators::construct(*(node_allocator*)this, boost::uint64_t(0));
+        get_bucket(0).store(head, boost::memory_order_relaxed);
+    }
+
+    ~lf_hash_map()
+    {
+        // Marked nodes are still in list, unlinked ones belong to reclamation_
+        node* n = get_bucket(0).load(boost::memory_order_relaxed);
+        while (n)
+        {
+            node* next = unmarked(n->next_.load(boost::memory_order_relaxed));
+            allocators::destroy(*(node_allocator*)this, n);
+            n = next;
+        }
+
+        bucket_allocator allocator(*(node_allocator*)this);
+        for (size_t i = 0; i < segments_count; ++i)
+        {
+            if (bucket* s = segments_[i].load(boost::memory_order_relaxed))
+                allocators::destroy_array(allocator, s, segment_size(i));
+        }
+    }
+
+    /// Return false if key is already there.
+    bool insert(const Key& key, const Value& value)
+    {
+        const size_t hash = hash_(key);
+        const boost::uint64_t so_key = regular_key(hash);
+        node* head = bucket_head(hash & (bucket_count_.load(boost::memory_order_acquire) - 1));
+
+        node* new_node = 0;
+        cursor c(reclamation_);
+        for(;;)
+        {
+            if (search(head, so_key, &key, c))
+            {
+                if (new_node)
+                    allocators::destroy(*(node_allocator*)this, new_node);
+
+                return false;
+            }
+
+            if (!new_node)
+                new_node = allocators::construct(*(node_allocator*)this, so_key, key, value);
+
+            new_node->next_.store(c.cur_, boost::memory_order_relaxed);
+
+            node* expected = c.cur_;
+            if (c.prev_->compare_exchange_strong(expected, new_node, boost::memory_order_release, boost::memory_order_relaxed))
+                break;
+        }
+
+        size_t count = bucket_count_.load(boost::memory_order_relaxed);
+        if (size_.fetch_add(1, boost::memory_order_relaxed) + 1 > count * max_load)
+            bucket_count_.compare_exchange_strong(count, count * 2, boost::memory_order_release, boost::memory_order_relaxed);
+
+        return true;
+    }
+
+    /// Copy value to result, return false if there is no such key.
+    bool find(const Key& key, Value& result)
+    {
+        const size_t hash = hash_(key);
+        node* head = bucket_head(hash & (bucket_count_.load(boost::memory_order_acquire) - 1));
+
+        cursor c(reclamation_);
+        if (!search(head, regular_key(hash), &key, c))
+            return false;
+
+        result = c.cur_->value()->second;
+        return true;
+    }
+
+    /// Return false if there is no such key.
+    bool erase(const Key& key)
+    {
+        const size_t hash = hash_(key);
+        const boost::uint64_t so_key = regular_key(hash);
+        node* head = bucket_head(hash & (bucket_count_.load(boost::memory_order_acquire) - 1));
+
+        cursor c(reclamation_);
+        for(;;)
+        {
+            if (!search(head, so_key, &key, c))
+                return false;
+
+            // Mark first, so that nobody inserts after erased node
+            node* next = c.next_;
+            if (!c.cur_->next_.compare_exchange_strong(next, marked(next), boost::memory_order_acq_rel, boost::memory_order_relaxed))
+                continue;
+
+            node* expected = c.cur_;
+            if (c.prev_->compare_exchange_strong(expected, next, boost::memory_order_acq_rel, boost::memory_order_relaxed))
+                reclamation_.reclaim_later(c.cur_, (node_allocator&)*this);
+            else
+                search(head, so_key, &key, c);
+
+            size_.fetch_sub(1, boost::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    /// Number of elements, approximate while other threads modify map.
+    size_t size() const
+    {
+        return size_.load(boost::memory_order_relaxed);
+    }
+
+    size_t bucket_count() const
+    {
+        return bucket_count_.load(boost::memory_order_relaxed);
+    }
+
+    /// True if atomics of map don`t fall back to locks on this platform
+    bool is_lock_free() const
+    {
+        return size_.is_lock_free() && segments_[0].is_lock_free();
+    }
+
+private:
+    static node* marked(node* n)
+    {
+        return reinterpret_cast<node*>(reinterpret_cast<boost::uintptr_t>(n) | 1);
+    }
+
+    static node* unmarked(node* n)
+    {
+        return reinterpret_cast<node*>(reinterpret_cast<boost::uintptr_t>(n) & ~boost::uintptr_t(1));
+    }
+
+    static bool is_marked(node* n)
+    {
+        return reinterpret_cast<boost::uintptr_t>(n) & 1;
+    }
+
+    static boost::uint64_t regular_key(size_t hash)
+    {
+        return detail::lf_hash_map_reverse(hash) | 1;
+    }
+
+    static boost::uint64_t dummy_key(size_t bucket_idx)
+    {
+        return detail::lf_hash_map_reverse(bucket_idx);
+    }
+
+    static size_t segment_size(size_t segment)
+    {
+        return segment ? size_t(1) << (segment - 1) : 1;
+    }
+
+    /// Slot of bucket, allocate its segment if needed
+    bucket& get_bucket(size_t idx)
+    {
+        const size_t segment = idx ? detail::lf_hash_map_log2(idx) + 1 : 0;
+        bucket* s = segments_[segment].load(boost::memory_order_acquire);
+        if (!s)
+        {
+            bucket_allocator allocator(*(node_allocator*)this);
+            bucket* new_segment = allocators::construct_array(allocator, segment_size(segment), (node*)0);
+
+            if (segments_[segment].compare_exchange_strong(s, new_segment, boost::memory_order_acq_rel, boost::memory_order_acquire))
+                s = new_segment;
+            else
+                allocators::destroy_array(allocator, new_segment, segment_size(segment));
+        }
+
+        return s[segment ? idx - segment_size(segment) : 0];
+    }
+
+    /// Dummy node of bucket, insert it if bucket is not initialized yet.
+    /// Dummy nodes are never erased, so no hazard pointer is needed for it.
+    node* bucket_head(size_t idx)
+    {
+        bucket& b = get_bucket(idx);
+        if (node* head = b.load(boost::memory_order_acquire))
+            return head;
+
+        // Parent bucket is the one this bucket was split from
+        node* parent = bucket_head(idx & ~(size_t(1) << detail::lf_hash_map_log2(idx)));
+        node* dummy = allocators::construct(*(node_allocator*)this, dummy_key(idx));
+
+        cursor c(reclamation_);
+        for(;;)
+        {
+            if (search(parent, dummy->so_key_, 0, c))
+            {
+                // Somebody has inserted it already
+                allocators::destroy(*(node_allocator*)this, dummy);
+                dummy = c.cur_;
+                break;
+            }
+
+            dummy->next_.store(c.cur_, boost::memory_order_relaxed);
+
+            node* expected = c.cur_;
+            if (c.prev_->compare_exchange_strong(expected, dummy, boost::memory_order_release, boost::memory_order_relaxed))
+                break;
+        }
+
+        b.store(dummy, boost::memory_order_release);
+        return dummy;
+    }
+
+    /// Find node with split order key so_key and key, key is 0 for dummy.
+    /// Return false if there is no such node, then c.cur_ is the first node
+    /// after the place where it would be. Unlinks erased nodes on the way.
+    bool search(node* head, boost::uint64_t so_key, const Key* key, cursor& c)
+    {
+    retry:
+        c.prev_ = &head->next_;
+        c.cur_ = c.prev_->load(boost::memory_order_acquire);
+        c.cur_hp_->set(c.cur_);
+        if (c.prev_->load(boost::memory_order_acquire) != c.cur_)
+            goto retry;
+
+        for(;;)
+        {
+            if (!c.cur_)
+                return false;
+
+            node* next = c.cur_->next_.load(boost::memory_order_acquire);
+            c.next_hp_->set(unmarked(next));
+            if (c.cur_->next_.load(boost::memory_order_acquire) != next)
+                goto retry;
+
+            if (c.prev_->load(boost::memory_order_acquire) != c.cur_)
+                goto retry;
+
+            if (!is_marked(next))
+            {
+                const boost::uint64_t cur_key = c.cur_->so_key_;
+                if (cur_key > so_key)
+                    return false;
+
+                // Different keys may have the same hash, check whole run
+                if (cur_key == so_key && (!key || pred_(c.cur_->value()->first, *key)))
+                {
+                    c.next_ = next;
+                    return true;
+                }
+
+                c.prev_ = &c.cur_->next_;
+                std::swap(c.prev_hp_, c.cur_hp_);
+            }
+            else
+            {
+                node* expected = c.cur_;
+                if (!c.prev_->compare_exchange_strong(expected, unmarked(next), boost::memory_order_acq_rel, boost::memory_order_relaxed))
+                    goto retry;
+
+                reclamation_.reclaim_later(c.cur_, (node_allocator&)*this);
+            }
+
+            c.cur_ = unmarked(next);
+            std::swap(c.cur_hp_, c.next_hp_);
+        }
+    }
+
+    reclamation_type reclamation_;
+
+    Hash hash_;
+    Pred pred_;
+    char pad0_[cache_line_size];
+
+    // Written by every insert and erase, keep it apart from read-mostly members
+    boost::atomic<size_t> size_;
+    char pad1_[cache_line_size];
+
+    boost::atomic<size_t> bucket_count_;
+    boost::atomic<bucket*> segments_[segments_count];
+};
+
+}}
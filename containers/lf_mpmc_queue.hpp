@@ -1,37 +1,39 @@
 #pragma once
 
+#include "atomic_counted_ptr.hpp"
+
 #include <tcl/allocators/construct_destroy.hpp>
+#include <tcl/cache_line.hpp>
+#include <tcl/statistics.hpp>
 
 #include <boost/atomic.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+
+#include <memory>
+#include <new>
 
 namespace tcl { namespace containers {
 
 namespace detail {
 
-template<typename T>
-struct lf_mpmc_queue_node;
-
-template<typename T>
-struct lf_mpmc_queue_counted_node_ptr
-{
-    int external_count_;
-    lf_mpmc_queue_node<T>* node_;
-};
-
 struct lf_mpmc_queue_node_counter
 {
     int internal_count_:30;
     unsigned external_counters_:2;
 };
 
+// Value is kept inline in node, so all memory comes from queue allocator.
+// Producer that wins has_data_ flag owns the node until it moves tail_ on.
 template<typename T>
 struct lf_mpmc_queue_node
 {
-    boost::atomic<T*> data_;
+    boost::atomic<bool> has_data_;
     boost::atomic<lf_mpmc_queue_node_counter> count_;
-    lf_mpmc_queue_counted_node_ptr<T> next_;
+    counted_ptr<lf_mpmc_queue_node<T> > next_;
+    typename boost::aligned_storage<sizeof(T), boost::alignment_of<T>::value>::type storage_;
 
-    lf_mpmc_queue_node()
+    lf_mpmc_queue_node() : has_data_(false)
     {
         lf_mpmc_queue_node_counter new_count;
         new_count.internal_count_ = 0;
@@ -61,15 +63,25 @@ struct lf_mpmc_queue_node
         if (!new_counter.internal_count_ && !new_counter.external_counters_)
             allocators::destroy(allocator, this);
     }
+
+    T* value()
+    {
+        return static_cast<T*>(static_cast<void*>(&storage_));
+    }
 };
 
 }
 
+/// \brief Unbounded multi producer, multi consumer lock-free queue.
+///
+/// Nodes are reclaimed with split reference counts. Values are stored
+/// inline in nodes, so once allocator pool is warm queue works without
+/// allocations. T move constructor must not throw.
 template<typename T, typename Allocator>
 class lf_mpmc_queue : Allocator::template rebind<detail::lf_mpmc_queue_node<T> >::other
 {
     typedef detail::lf_mpmc_queue_node<T> node;
-    typedef detail::lf_mpmc_queue_counted_node_ptr<T> counted_node_ptr;
+    typedef counted_ptr<node> counted_node_ptr;
     typedef detail::lf_mpmc_queue_node_counter node_counter;
 
     typedef typename Allocator::template rebind<node>::other node_allocator;
@@ -91,26 +103,34 @@ public:
         while(try_pop(dummy));
         allocators::destroy(
             *(node_allocator*)this
-          , head_.load(boost::memory_order_relaxed).node_
+          , head_.peek().node_
           );
     }
 
     bool try_pop(T& result)
     {
-        counted_node_ptr old_head = head_.load(boost::memory_order_relaxed);
-        for(;;)
+        counted_node_ptr old_head = head_.peek();
+        unsigned failures = 0;
+        for(;; ++failures)
         {
-            increase_external_count(head_, old_head);
+            failures += increase_external_count(head_, old_head);
             node* const ptr = old_head.node_;
-            if (ptr == tail_.load().node_)
+            if (ptr == tail_.peek().node_)
+            {
+                ptr->release_ref(*(node_allocator*)this);
+                stats_.operation(failures);
                 return false;
+            }
 
             if (head_.compare_exchange_strong(old_head, ptr->next_))
             {
-                T* const res = ptr->data_.exchange(0);
+                // Value must be taken before node is released,
+                // it is freed by last reference holder.
+                T* const value = ptr->value();
+                result = std::move(*value);
+                value->~T();
                 free_external_count(old_head);
-                result = std::move(*res);
-                delete res;
+                stats_.operation(failures);
                 return true;
             }
 
@@ -120,49 +140,71 @@ public:
 
     void push(const T& new_value)
     {
-        std::unique_ptr<T> new_data(new T(new_value));
+        // Copy before node is claimed, so that throwing copy constructor
+        // doesn`t leave claimed node without value.
+        T new_data(new_value);
         counted_node_ptr new_next;
         new_next.node_ = allocators::construct(*(node_allocator*)this);
         new_next.external_count_ = 1;
-        counted_node_ptr old_tail = tail_.load();
+        counted_node_ptr old_tail = tail_.peek();
+        unsigned failures = 0;
 
-        for(;;)
+        for(;; ++failures)
         {
-            increase_external_count(tail_, old_tail);
+            failures += increase_external_count(tail_, old_tail);
 
-            T* old_data = 0;
-            if (old_tail.node_->data_.compare_exchange_strong(old_data, new_data.get()))
+            bool has_data = false;
+            if (old_tail.node_->has_data_.compare_exchange_strong(has_data, true))
             {
+                new (old_tail.node_->value()) T(std::move(new_data));
                 old_tail.node_->next_ = new_next;
                 old_tail = tail_.exchange(new_next);
                 free_external_count(old_tail);
-                new_data.release();
                 break;
             }
             old_tail.node_->release_ref(*(node_allocator*)this);
         }
+
+        stats_.operation(failures);
+    }
+
+    /// CAS failures of push and pop, zeros unless built with TCL_STATISTICS
+    statistics get_statistics() const
+    {
+        return stats_.get();
+    }
+
+    /// True if atomics of queue don`t fall back to locks on this platform
+    bool is_lock_free() const
+    {
+        return head_.is_lock_free() && tail_.is_lock_free()
+            && head_.peek().node_->count_.is_lock_free();
     }
 
 private:
 
-    static void increase_external_count(
-        boost::atomic<counted_node_ptr>& counter
+    // Return number of failed CAS
+    static unsigned increase_external_count(
+        atomic_counted_ptr<node>& counter
       , counted_node_ptr& old_counter)
     {
         counted_node_ptr new_counter;
+        unsigned failures = 0;
 
-        do
+        for(;; ++failures)
         {
             new_counter = old_counter;
             ++new_counter.external_count_;
+            if (counter.compare_exchange_strong(
+                old_counter,
+                new_counter,
+                boost::memory_order_acquire,
+                boost::memory_order_relaxed))
+                break;
         }
-        while(!counter.compare_exchange_strong(
-            old_counter,
-            new_counter,
-            boost::memory_order_acquire,
-            boost::memory_order_relaxed));
 
         old_counter.external_count_ = new_counter.external_count_;
+        return failures;
     }
 
     void free_external_count(counted_node_ptr& old_node_ptr)
@@ -182,7 +224,7 @@ private:
             old_counter,
             new_counter,
             boost::memory_order_acquire,
-            boost::memory_order_release));
+            boost::memory_order_relaxed));
 
         if(!new_counter.internal_count_ && !new_counter.external_counters_)
             allocators::destroy(*(node_allocator*)this, ptr);
@@ -192,8 +234,15 @@ private:
     lf_mpmc_queue& operator=(const lf_mpmc_queue&);
 
 private:
-    boost::atomic<counted_node_ptr> head_;
-    boost::atomic<counted_node_ptr> tail_;
+    // Consumers side
+    atomic_counted_ptr<node> head_;
+    char pad0_[cache_line_size];
+
+    // Producers side
+    atomic_counted_ptr<node> tail_;
+    char pad1_[cache_line_size];
+
+    statistics_counters stats_;
 };
 
 }}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+
+#include <memory>
+#include <new>
+
+namespace tcl { namespace containers {
+
+namespace detail {
+
+template<typename T>
+struct lf_mpmc_ring_cell
+{
+    boost::atomic<size_t> sequence_;
+    typename boost::aligned_storage<sizeof(T), boost::alignment_of<T>::value>::type storage_;
+
+    T* value()
+    {
+        return static_cast<T*>(static_cast<void*>(&storage_));
+    }
+};
+
+}
+
+/// \brief Bounded multi producer, multi consumer lock-free queue.
+///
+/// Each slot of the ring carries sequence number that tells whose turn it is.
+/// Slot at position pos is free for producer when its sequence equals pos, and
+/// ready for consumer when it equals pos + 1. Producers and consumers claim
+/// slots with single CAS on \c tail_ and \c head_ and values are stored inline,
+/// so there are no allocations after construction.
+/// See http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+///
+/// T copy constructor must not throw, otherwise claimed slot is never published.
+///
+/// \tparam Capacity - number of slots, must be power of two.
+/// \tparam Allocator - used once on construction to allocate slots.
+template<typename T, size_t Capacity, typename Allocator = std::allocator<T> >
+class lf_mpmc_ring : Allocator::template rebind<detail::lf_mpmc_ring_cell<T> >::other
+{
+    BOOST_STATIC_ASSERT_MSG(
+        Capacity && !(Capacity & (Capacity - 1)), "Capacity must be power of two");
+
+    typedef detail::lf_mpmc_ring_cell<T> cell;
+    typedef typename Allocator::template rebind<cell>::other cell_allocator;
+
+    static const size_t mask = Capacity - 1;
+
+    lf_mpmc_ring(const lf_mpmc_ring&);
+    lf_mpmc_ring& operator=(const lf_mpmc_ring&);
+
+public:
+    lf_mpmc_ring(const Allocator& allocator = Allocator())
+    : cell_allocator(allocator)
+    , buffer_(cell_allocator::allocate(Capacity))
+    , head_(0)
+    , tail_(0)
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+            new (&buffer_[i].sequence_) boost::atomic<size_t>(i);
+    }
+
+    ~lf_mpmc_ring()
+    {
+        const size_t tail = tail_.load(boost::memory_order_relaxed);
+        for (size_t i = head_.load(boost::memory_order_relaxed); i != tail; ++i)
+            buffer_[i & mask].value()->~T();
+
+        cell_allocator::deallocate(buffer_, Capacity);
+    }
+
+    /// Return false if ring is full.
+    bool try_push(const T& value)
+    {
+        cell* c;
+        size_t pos = tail_.load(boost::memory_order_relaxed);
+        for(;;)
+        {
+            c = &buffer_[pos & mask];
+            const size_t seq = c->sequence_.load(boost::memory_order_acquire);
+            const ptrdiff_t diff = static_cast<ptrdiff_t>(seq - pos);
+
+            if (0 == diff)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = tail_.load(boost::memory_order_relaxed);
+        }
+
+        new (c->value()) T(value);
+        c->sequence_.store(pos + 1, boost::memory_order_release);
+
+        return true;
+    }
+
+    /// Yield while ring is full.
+    void push(const T& value)
+    {
+        while (!try_push(value))
+            boost::this_thread::yield();
+    }
+
+    /// Return false if ring is empty.
+    bool try_pop(T& result)
+    {
+        cell* c;
+        size_t pos = head_.load(boost::memory_order_relaxed);
+        for(;;)
+        {
+            c = &buffer_[pos & mask];
+            const size_t seq = c->sequence_.load(boost::memory_order_acquire);
+            const ptrdiff_t diff = static_cast<ptrdiff_t>(seq - (pos + 1));
+
+            if (0 == diff)
+            {
+                if (head_.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = head_.load(boost::memory_order_relaxed);
+        }
+
+        T* value = c->value();
+        result = std::move(*value);
+        value->~T();
+        c->sequence_.store(pos + Capacity, boost::memory_order_release);
+
+        return true;
+    }
+
+    static size_t capacity()
+    {
+        return Capacity;
+    }
+
+    /// True if atomics of ring don`t fall back to locks on this platform
+    bool is_lock_free() const
+    {
+        return head_.is_lock_free() && tail_.is_lock_free() && buffer_[0].sequence_.is_lock_free();
+    }
+
+private:
+    // Read-only after construction, shared by all threads
+    cell* const buffer_;
+    char pad0_[cache_line_size];
+
+    // Consumers side
+    boost::atomic<size_t> head_;
+    char pad1_[cache_line_size];
+
+    // Producers side
+    boost::atomic<size_t> tail_;
+    char pad2_[cache_line_size];
+};
+
+}}
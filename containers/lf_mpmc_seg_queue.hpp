@@ -0,0 +1,233 @@
+#pragma once
+
+#include "epoch_domain.hpp"
+#include "hazard_pointers.hpp"
+
+#include <tcl/allocators/construct_destroy.hpp>
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+
+#include <memory>
+#include <new>
+
+namespace tcl { namespace containers {
+
+namespace detail {
+
+template<typename T, size_t Size>
+struct lf_mpmc_seg_queue_segment
+{
+    enum cell_state
+    {
+        empty,      //!< Nobody has touched cell yet
+        full,       //!< Producer has published value
+        taken       //!< Consumer has visited cell, producer must not publish here
+    };
+
+    struct cell
+    {
+        boost::atomic<unsigned char> state_;
+        typename boost::aligned_storage<sizeof(T), boost::alignment_of<T>::value>::type storage_;
+
+        T* value()
+        {
+            return static_cast<T*>(static_cast<void*>(&storage_));
+        }
+    };
+
+    lf_mpmc_seg_queue_segment() : deq_idx_(0), enq_idx_(0), next_(0)
+    {
+        for (size_t i = 0; i < Size; ++i)
+            cells_[i].state_.store(empty, boost::memory_order_relaxed);
+    }
+
+    boost::atomic<size_t> deq_idx_;
+    char pad0_[cache_line_size];
+
+    boost::atomic<size_t> enq_idx_;
+    char pad1_[cache_line_size];
+
+    boost::atomic<lf_mpmc_seg_queue_segment*> next_;
+    cell cells_[Size];
+};
+
+}
+
+/// \brief Unbounded multi producer, multi consumer lock-free queue built
+/// from linked fixed size array segments.
+///
+/// Producers and consumers claim cells with \c fetch_add on segment indices,
+/// CAS is needed only to publish value into claimed cell and to move on to
+/// the next segment. So contention is the same as in bounded array queue,
+/// but capacity is unbounded. Drained segments are reclaimed with hazard
+/// pointers or epochs. Values are stored inline in cells.
+/// See "A Wait-free Queue as Fast as Fetch-and-Add" by Yang and Mellor-Crummey
+/// and FAAArrayQueue by Ramalhete and Correia.
+///
+/// \tparam SegmentSize - number of cells in one segment.
+/// \tparam Allocator - used to allocate segments.
+/// \tparam Reclamation - \c hazard_pointers or \c epoch_domain, rebound to segment type.
+template<
+    typename T
+  , size_t SegmentSize = 1024
+  , typename Allocator = std::allocator<T>
+  , typename Reclamation = hazard_pointers<void, 10>
+  >
+class lf_mpmc_seg_queue : Allocator::template rebind<detail::lf_mpmc_seg_queue_segment<T, SegmentSize> >::other
+{
+    typedef detail::lf_mpmc_seg_queue_segment<T, SegmentSize> segment;
+    typedef typename Allocator::template rebind<segment>::other segment_allocator;
+
+    lf_mpmc_seg_queue(const lf_mpmc_seg_queue&);
+    lf_mpmc_seg_queue& operator=(const lf_mpmc_seg_queue&);
+
+public:
+    typedef typename Reclamation::template rebind<segment>::other reclamation_type;
+
+    lf_mpmc_seg_queue(const Allocator& allocator = Allocator())
+        : segment_allocator(allocator)
+    {
+        segment* s = allocators::construct(*(segment_allocator*)this);
+        head_.store(s, boost::memory_order_relaxed);
+        tail_.store(s, boost::memory_order_relaxed);
+    }
+
+    ~lf_mpmc_seg_queue()
+    {
+        segment* s = head_.load(boost::memory_order_relaxed);
+        while (s)
+        {
+            for (size_t i = 0; i < SegmentSize; ++i)
+            {
+                if (segment::full == s->cells_[i].state_.load(boost::memory_order_relaxed))
+                    s->cells_[i].value()->~T();
+            }
+
+            segment* next = s->next_.load(boost::memory_order_relaxed);
+            allocators::destroy(*(segment_allocator*)this, s);
+            s = next;
+        }
+    }
+
+    void push(const T& value)
+    {
+        typename reclamation_type::guard hp(reclamation_);
+
+        for(;;)
+        {
+            segment* tail = hp.protect(tail_);
+
+            const size_t idx = tail->enq_idx_.fetch_add(1);
+            if (idx < SegmentSize)
+            {
+                typename segment::cell& c = tail->cells_[idx];
+                new (c.value()) T(value);
+
+                unsigned char state = segment::empty;
+                if (c.state_.compare_exchange_strong(
+                        state, segment::full, boost::memory_order_release, boost::memory_order_relaxed))
+                    break;
+
+                // Consumer has already given up on this cell, try next one
+                c.value()->~T();
+                continue;
+            }
+
+            // Segment is full, link new one or help to move tail_
+            if (tail != tail_.load())
+                continue;
+
+            segment* next = tail->next_.load();
+            if (!next)
+            {
+                segment* new_segment = allocators::construct(*(segment_allocator*)this);
+                new (new_segment->cells_[0].value()) T(value);
+                new_segment->cells_[0].state_.store(segment::full, boost::memory_order_relaxed);
+                new_segment->enq_idx_.store(1, boost::memory_order_relaxed);
+
+                if (tail->next_.compare_exchange_strong(next, new_segment))
+                {
+                    tail_.compare_exchange_strong(tail, new_segment);
+                    break;
+                }
+
+                new_segment->cells_[0].value()->~T();
+                allocators::destroy(*(segment_allocator*)this, new_segment);
+            }
+
+            tail_.compare_exchange_strong(tail, next);
+        }
+    }
+
+    bool try_pop(T& result)
+    {
+        typename reclamation_type::guard hp(reclamation_);
+
+        for(;;)
+        {
+            segment* head = hp.protect(head_);
+
+            if (head->deq_idx_.load() >= head->enq_idx_.load() && !head->next_.load())
+                return false;
+
+            const size_t idx = head->deq_idx_.fetch_add(1);
+            if (idx >= SegmentSize)
+            {
+                // Segment is drained, move on to the next one
+                segment* next = head->next_.load();
+                if (!next)
+                    return false;
+
+                // Producer that linked next may not have moved tail_ yet.
+                // Help it, so that tail_ never points to segment that is
+                // behind head_ and may be retired.
+                segment* tail = head;
+                tail_.compare_exchange_strong(tail, next);
+
+                if (head_.compare_exchange_strong(head, next))
+                    reclamation_.reclaim_later(head, (segment_allocator&)*this);
+
+                continue;
+            }
+
+            typename segment::cell& c = head->cells_[idx];
+            if (segment::full == c.state_.exchange(segment::taken, boost::memory_order_acquire))
+            {
+                T* value = c.value();
+                result = std::move(*value);
+                value->~T();
+                return true;
+            }
+
+            // Producer hasn`t published value yet, it will retry with another cell
+        }
+    }
+
+    /// Reclamation domain of drained segments
+    reclamation_type& reclamation()
+    {
+        return reclamation_;
+    }
+
+    /// True if atomics of queue don`t fall back to locks on this platform
+    bool is_lock_free() const
+    {
+        return head_.is_lock_free() && tail_.is_lock_free();
+    }
+
+private:
+    // Read by every operation, keep it apart from head and tail
+    reclamation_type reclamation_;
+    char pad0_[cache_line_size];
+
+    boost::atomic<segment*> head_;
+    char pad1_[cache_line_size];
+
+    boost::atomic<segment*> tail_;
+    char pad2_[cache_line_size];
+};
+
+}}
@@ -0,0 +1,633 @@
+#pragma once
+
+#include "hazard_pointers.hpp"
+
+#include <tcl/allocators/construct_destroy.hpp>
+#include <tcl/allocators/fixed_allocator.hpp>
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/optional.hpp>
+#include <boost/ref.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/utility/in_place_factory.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <utility>
+
+namespace tcl { namespace containers {
+
+namespace detail {
+
+/// Tower height with probability 1/4 to grow one more level, xorshift per thread
+inline unsigned lf_skiplist_random_height(unsigned max_height)
+{
+    static thread_local boost::uint32_t seed = 0;
+    if (!seed)
+        seed = static_cast<boost::uint32_t>(reinterpret_cast<boost::uintptr_t>(&seed) >> 4) | 1;
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    unsigned height = 1;
+    for (boost::uint32_t bits = seed; height < max_height && !(bits & 3); bits >>= 2)
+        ++height;
+
+    return height;
+}
+
+/// Node with full tower, so that all nodes have the same size and come
+/// from one pool. Tower levels above \c height_ are never linked.
+template<typename Key, typename Value, unsigned MaxHeight>
+struct lf_skiplist_node
+{
+    typedef std::pair<const Key, Value> value_type;
+
+    /// Head sentinel, doesn`t have value
+    lf_skiplist_node()
+        : height_(MaxHeight)
+        , sentinel_(true)
+    {
+        for (unsigned i = 0; i < MaxHeight; ++i)
+            next_[i].store(0, boost::memory_order_relaxed);
+    }
+
+    lf_skiplist_node(const Key& key, const Value& value, unsigned height)
+        : height_(height)
+        , sentinel_(false)
+    {
+        new (&storage_) value_type(key, value);
+        for (unsigned i = 0; i < MaxHeight; ++i)
+            next_[i].store(0, boost::memory_order_relaxed);
+    }
+
+    ~lf_skiplist_node()
+    {
+        if (!sentinel_)
+            value()->~value_type();
+    }
+
+    value_type* value()
+    {
+        return static_cast<value_type*>(static_cast<void*>(&storage_));
+    }
+
+    const Key& key()
+    {
+        return value()->first;
+    }
+
+    const unsigned height_;
+    const bool sentinel_;
+    typename boost::aligned_storage<sizeof(value_type), boost::alignment_of<value_type>::value>::type storage_;
+
+    /// Lowest bit is set when node is erased, level 0 decides who erased it
+    boost::atomic<lf_skiplist_node*> next_[MaxHeight];
+};
+
+}
+
+/// \brief Lock-free ordered map on skiplist.
+///
+/// Each level is a lock-free sorted list, node is erased by marking its next
+/// pointers from top to bottom, mark on the lowest level decides which thread
+/// has erased it. Searches unlink marked nodes they pass by. See
+/// "The Art of Multiprocessor Programming" by Herlihy and Shavit, chapter 14.
+///
+/// Traversal is protected by hazard pointers. Update holds two of them per
+/// level for predecessors and successors it is going to link between, so
+/// reclamation domain must have at least 2 * MaxHeight + 2 pointers per thread,
+/// plus one for each live iterator. Erased node is reclaimed when it has been
+/// unlinked from all levels.
+///
+/// All nodes have the full tower of MaxHeight links, so they are of one size
+/// and allocator can pool them. Default allocator is fixed_allocator.
+///
+/// Values can`t be changed after insert. Iterator holds hazard pointer to its
+/// node, so value stays valid while iterator points to it even if it is
+/// erased meanwhile. Incrementing iterator over erased node continues from
+/// the first node greater than its key. Iterator must stay in thread that
+/// has created it.
+///
+/// \tparam MaxHeight - maximum tower height, 12 is good for 16M elements.
+///                     Search needs 2 * MaxHeight + 2 hazard pointers, so it
+///                     can`t be more than 15.
+template<
+    typename Key
+  , typename Value
+  , typename Compare = std::less<Key>
+  , typename Allocator = allocators::fixed_allocator<std::pair<const Key, Value>, 4096>
+  , typename Reclamation = hazard_pointers<void, 32>
+  , unsigned MaxHeight = 12
+  >
+class lf_skiplist_map : Allocator::template rebind<detail::lf_skiplist_node<Key, Value, MaxHeight> >::other
+{
+    BOOST_STATIC_ASSERT_MSG(MaxHeight > 0 && MaxHeight <= 15, "MaxHeight must be in [1, 15]");
+
+    typedef detail::lf_skiplist_node<Key, Value, MaxHeight> node;
+    typedef typename Allocator::template rebind<node>::other node_allocator;
+
+    typedef typename Reclamation::template rebind<node>::other reclamation_type;
+    typedef typename reclamation_type::guard guard;
+
+    static const unsigned guards_count = 2 * MaxHeight + 2;
+
+    /// Hazard pointers of one search and predecessors and successors it found.
+    /// Guards are taken on demand, update keeps two per level, lookup only few.
+    class cursor
+    {
+        cursor(const cursor&);
+        cursor& operator=(const cursor&);
+
+    public:
+        cursor(reclamation_type& reclamation, bool keep_levels)
+            : reclamation_(reclamation)
+            , keep_levels_(keep_levels)
+            , constructed_(0)
+            , free_count_(0)
+        {
+        }
+
+        ~cursor()
+        {
+            for (unsigned i = 0; i < constructed_; ++i)
+                get(i)->~guard();
+        }
+
+        guard* take()
+        {
+            if (free_count_)
+                return free_[--free_count_];
+
+            assert("Ensure that search has enough hazard pointers" && constructed_ < guards_count);
+            return new (&storage_[constructed_++]) guard(reclamation_);
+        }
+
+        void give(guard* g)
+        {
+            free_[free_count_++] = g;
+        }
+
+        /// Give all guards back, they are reused by next search
+        void reset()
+        {
+            free_count_ = constructed_;
+            for (unsigned i = 0; i < constructed_; ++i)
+                free_[i] = get(i);
+        }
+
+        bool keep_levels() const
+        {
+            return keep_levels_;
+        }
+
+        node* preds_[MaxHeight];
+        node* succs_[MaxHeight];
+
+    private:
+        guard* get(unsigned i)
+        {
+            return static_cast<guard*>(static_cast<void*>(&storage_[i]));
+        }
+
+        reclamation_type& reclamation_;
+        const bool keep_levels_;
+
+        typename boost::aligned_storage<sizeof(guard), boost::alignment_of<guard>::value>::type storage_[guards_count];
+        unsigned constructed_;
+
+        guard* free_[guards_count];
+        unsigned free_count_;
+    };
+
+    lf_skiplist_map(const lf_skiplist_map&);
+    lf_skiplist_map& operator=(const lf_skiplist_map&);
+
+public:
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<const Key, Value> value_type;
+
+    /// \brief Forward iterator over map, holds one hazard pointer.
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename lf_skiplist_map::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        iterator()
+            : map_(0)
+            , node_(0)
+        {
+        }
+
+        iterator(const iterator& other)
+            : map_(other.map_)
+            , node_(0)
+        {
+            reset(other.node_);
+        }
+
+        iterator& operator=(const iterator& other)
+        {
+            if (this != &other)
+            {
+                map_ = other.map_;
+                reset(other.node_);
+            }
+
+            return *this;
+        }
+
+        reference operator*() const
+        {
+            return *node_->value();
+        }
+
+        pointer operator->() const
+        {
+            return node_->value();
+        }
+
+        iterator& operator++()
+        {
+            map_->advance(*this);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator tmp(*this);
+            ++*this;
+            return tmp;
+        }
+
+        bool operator==(const iterator& other) const
+        {
+            return node_ == other.node_;
+        }
+
+        bool operator!=(const iterator& other) const
+        {
+            return node_ != other.node_;
+        }
+
+    private:
+        friend class lf_skiplist_map;
+
+        explicit iterator(lf_skiplist_map* map)
+            : map_(map)
+            , node_(0)
+        {
+        }
+
+        /// Point to n, n must be protected by somebody else right now
+        void reset(node* n)
+        {
+            if (n && !guard_)
+                guard_ = boost::in_place(boost::ref(map_->reclamation_));
+
+            if (guard_)
+                guard_->set(n);
+
+            node_ = n;
+        }
+
+        lf_skiplist_map* map_;
+        node* node_;
+        boost::optional<guard> guard_;
+    };
+
+    typedef iterator const_iterator;
+
+    lf_skiplist_map(const Compare& compare = Compare(), const Allocator& allocator = Allocator())
+        : node_allocator(allocator)
+        , compare_(compare)
+        , head_(allocators::construct(*(node_allocator*)this))
+        , height_(1)
+        , size_(0)
+    {
+    }
+
+    ~lf_skiplist_map()
+    {
+        // Erased nodes still linked at level 0 are here, unlinked ones belong to reclamation_
+        node* n = head_;
+        while (n)
+        {
+            node* next = unmarked(n->next_[0].load(boost::memory_order_relaxed));
+            allocators::destroy(*(node_allocator*)this, n);
+            n = next;
+        }
+    }
+
+    /// Return false if key is already there.
+    bool insert(const Key& key, const Value& value)
+    {
+        const unsigned height = detail::lf_skiplist_random_height(MaxHeight);
+
+        unsigned top = height_.load(boost::memory_order_relaxed);
+        while (top < height && !height_.compare_exchange_weak(top, height, boost::memory_order_relaxed));
+
+        cursor c(reclamation_, true);
+        guard new_node_hp(reclamation_);
+        node* new_node = 0;
+
+        for(;;)
+        {
+            node* found = search(&key, false, c);
+            if (found && !compare_(key, found->key()))
+            {
+                if (new_node)
+                    allocators::destroy(*(node_allocator*)this, new_node);
+
+                return false;
+            }
+
+            if (!new_node)
+            {
+                new_node = allocators::construct(*(node_allocator*)this, key, value, height);
+                new_node_hp.set(new_node);
+            }
+
+            for (unsigned level = 0; level < new_node->height_; ++level)
+                new_node->next_[level].store(c.succs_[level], boost::memory_order_relaxed);
+
+            // Node is in map once it is linked on level 0
+            node* expected = c.succs_[0];
+            if (c.preds_[0]->next_[0].compare_exchange_strong(expected, new_node, boost::memory_order_release, boost::memory_order_relaxed))
+                break;
+        }
+
+        size_.fetch_add(1, boost::memory_order_relaxed);
+
+        for (unsigned level = 1; level < new_node->height_; ++level)
+        {
+            if (!link(new_node, level, c))
+                break;
+        }
+
+        // Eraser may have unlinked node before we linked it on some level
+        if (is_marked(new_node->next_[0].load(boost::memory_order_acquire)))
+            search(&key, false, c);
+
+        return true;
+    }
+
+    /// Return false if there is no such key.
+    bool erase(const Key& key)
+    {
+        cursor c(reclamation_, false);
+        node* n = search(&key, false, c);
+        if (!n || compare_(key, n->key()))
+            return false;
+
+        for (unsigned level = n->height_ - 1; level > 0; --level)
+        {
+            node* next = n->next_[level].load(boost::memory_order_relaxed);
+            while (!is_marked(next) && !n->next_[level].compare_exchange_weak(next, marked(next), boost::memory_order_acq_rel, boost::memory_order_relaxed));
+        }
+
+        node* next = n->next_[0].load(boost::memory_order_relaxed);
+        for(;;)
+        {
+            if (is_marked(next))
+                return false;
+
+            if (n->next_[0].compare_exchange_weak(next, marked(next), boost::memory_order_acq_rel, boost::memory_order_relaxed))
+                break;
+        }
+
+        // Unlink from all levels, after that nobody can find the node
+        search(&key, false, c);
+        reclamation_.reclaim_later(n, (node_allocator&)*this);
+
+        size_.fetch_sub(1, boost::memory_order_relaxed);
+        return true;
+    }
+
+    /// Copy value to result, return false if there is no such key.
+    bool find(const Key& key, Value& result)
+    {
+        cursor c(reclamation_, false);
+        node* n = search(&key, false, c);
+        if (!n || compare_(key, n->key()))
+            return false;
+
+        result = n->value()->second;
+        return true;
+    }
+
+    /// First element not less than key.
+    iterator lower_bound(const Key& key)
+    {
+        cursor c(reclamation_, false);
+        iterator it(this);
+        it.reset(search(&key, false, c));
+        return it;
+    }
+
+    iterator begin()
+    {
+        cursor c(reclamation_, false);
+        iterator it(this);
+        it.reset(search(0, false, c));
+        return it;
+    }
+
+    iterator end()
+    {
+        return iterator(this);
+    }
+
+    /// Number of elements, approximate while other threads modify map.
+    size_t size() const
+    {
+        return size_.load(boost::memory_order_relaxed);
+    }
+
+    /// True if atomics of map don`t fall back to locks on this platform
+    bool is_lock_free() const
+    {
+        return head_->next_[0].is_lock_free() && height_.is_lock_free() && size_.is_lock_free();
+    }
+
+private:
+    static node* marked(node* n)
+    {
+        return reinterpret_cast<node*>(reinterpret_cast<boost::uintptr_t>(n) | 1);
+    }
+
+    static node* unmarked(node* n)
+    {
+        return reinterpret_cast<node*>(reinterpret_cast<boost::uintptr_t>(n) & ~boost::uintptr_t(1));
+    }
+
+    static bool is_marked(node* n)
+    {
+        return reinterpret_cast<boost::uintptr_t>(n) & 1;
+    }
+
+    /// Protect ptr, which was loaded from src, and check that src hasn`t changed
+    static bool protect(guard* g, node* ptr, const boost::atomic<node*>& src, node* expected)
+    {
+        if (unmarked(ptr))
+            g->set(unmarked(ptr));
+
+        return src.load(boost::memory_order_acquire) == expected;
+    }
+
+    /// Link node on level between predecessor and successor found by last search.
+    /// Return false if node has been erased meanwhile.
+    bool link(node* n, unsigned level, cursor& c)
+    {
+        for(;;)
+        {
+            node* succ = c.succs_[level];
+            node* next = n->next_[level].load(boost::memory_order_acquire);
+            while (next != succ)
+            {
+                if (is_marked(next))
+                    return false;
+
+                if (n->next_[level].compare_exchange_weak(next, succ, boost::memory_order_release, boost::memory_order_relaxed))
+                    next = succ;
+            }
+
+            node* expected = succ;
+            if (c.preds_[level]->next_[level].compare_exchange_strong(expected, n, boost::memory_order_release, boost::memory_order_relaxed))
+                return true;
+
+            search(&n->key(), false, c);
+            if (is_marked(n->next_[0].load(boost::memory_order_acquire)))
+                return false;
+        }
+    }
+
+    /// Move iterator to the next node
+    void advance(iterator& it)
+    {
+        node* n = it.node_;
+
+        // Cheap path, node is still in map, so its successor is too
+        node* next = n->next_[0].load(boost::memory_order_acquire);
+        if (!is_marked(next))
+        {
+            guard g(reclamation_);
+            if (protect(&g, next, n->next_[0], next))
+            {
+                it.reset(next);
+                return;
+            }
+        }
+
+        cursor c(reclamation_, false);
+        it.reset(search(&n->key(), true, c));
+    }
+
+    /// Fill c.preds_ and c.succs_ with nodes around the first node not less
+    /// than key (greater than key if upper), return that node protected by
+    /// hazard pointer of c. Null key is less than anything. Unlinks erased
+    /// nodes on the way.
+    node* search(const Key* key, bool upper, cursor& c)
+    {
+    retry:
+        c.reset();
+
+        node* pred = head_;
+        guard* pred_hp = 0;
+        bool pred_hp_owned = false;     // otherwise it protects preds_ of upper level
+
+        // Levels above the highest tower are empty
+        const int top = height_.load(boost::memory_order_relaxed);
+        for (int level = MaxHeight - 1; level >= top; --level)
+        {
+            c.preds_[level] = head_;
+            c.succs_[level] = 0;
+        }
+
+        for (int level = top - 1; level >= 0; --level)
+        {
+            guard* curr_hp = c.take();
+            guard* succ_hp = c.take();
+
+            node* curr = pred->next_[level].load(boost::memory_order_acquire);
+            if (is_marked(curr) || !protect(curr_hp, curr, pred->next_[level], curr))
+                goto retry;
+
+            while (curr)
+            {
+                node* succ = curr->next_[level].load(boost::memory_order_acquire);
+                if (is_marked(succ))
+                {
+                    // Marked link never changes, succ is there while curr is linked
+                    if (!protect(succ_hp, succ, pred->next_[level], curr))
+                        goto retry;
+
+                    node* expected = curr;
+                    if (!pred->next_[level].compare_exchange_strong(expected, unmarked(succ), boost::memory_order_acq_rel, boost::memory_order_relaxed))
+                        goto retry;
+
+                    curr = unmarked(succ);
+                    std::swap(curr_hp, succ_hp);
+                }
+                else if (key && (upper ? !compare_(*key, curr->key()) : compare_(curr->key(), *key)))
+                {
+                    // Unmarked link means curr is still linked, so is succ
+                    if (!protect(succ_hp, succ, curr->next_[level], succ))
+                        goto retry;
+
+                    if (pred_hp && (pred_hp_owned || !c.keep_levels()))
+                        c.give(pred_hp);
+
+                    pred = curr;
+                    pred_hp = curr_hp;
+                    pred_hp_owned = true;
+
+                    curr = succ;
+                    curr_hp = succ_hp;
+                    succ_hp = c.take();
+                }
+                else
+                    break;
+            }
+
+            c.give(succ_hp);
+            if (level && !c.keep_levels())
+                c.give(curr_hp);
+
+            c.preds_[level] = pred;
+            c.succs_[level] = curr;
+
+            // Guards of this level protect preds_ and succs_ from now on
+            pred_hp_owned = false;
+        }
+
+        return c.succs_[0];
+    }
+
+    reclamation_type reclamation_;
+    Compare compare_;
+
+    node* const head_;
+    boost::atomic<unsigned> height_;    //!< Highest tower ever inserted, searches start there
+    char pad0_[cache_line_size];
+
+    // Written by every insert and erase, keep it apart from read-mostly members
+    boost::atomic<size_t> size_;
+    char pad1_[cache_line_size];
+};
+
+}}
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+
+#include <memory>
+
 namespace tcl { namespace containers {
 
 template<typename T>
@@ -24,6 +30,43 @@ public:
         tail_.store(new_tail.release(), boost::memory_order_release);
     }
 
+    /// Push all values from [first, last) and publish them to consumer
+    /// with single release store.
+    template<typename InputIterator>
+    void push_range(InputIterator first, InputIterator last)
+    {
+        node* const old_tail = tail_.load(boost::memory_order_relaxed);
+        node* new_tail = old_tail;
+
+        try
+        {
+            for (; first != last; ++first)
+            {
+                std::unique_ptr<node> next(new node);
+                new_tail->data_ = std::make_shared<T>(*first);
+                new_tail->next_ = next.get();
+                new_tail = next.release();
+            }
+        }
+        catch(...)
+        {
+            // Nothing was published yet, unlink and free what was built
+            for (node* n = old_tail->next_; n; )
+            {
+                node* next = n->next_;
+                delete n;
+                n = next;
+            }
+
+            old_tail->data_.reset();
+            old_tail->next_ = 0;
+            throw;
+        }
+
+        if (new_tail != old_tail)
+            tail_.store(new_tail, boost::memory_order_release);
+    }
+
     std::shared_ptr<T> try_pop()
     {
         std::shared_ptr<T> res;
@@ -41,6 +84,38 @@ public:
         return res;
     }
 
+    bool try_pop(T& result)
+    {
+        return pop_n(&result, 1) == 1;
+    }
+
+    /// Move up to max values to out. Everything that was published
+    /// by producer is observed with single acquire load.
+    /// Return number of values popped.
+    template<typename OutputIterator>
+    size_t pop_n(OutputIterator out, size_t max)
+    {
+        node* const tail = tail_.load(boost::memory_order_acquire);
+
+        size_t n = 0;
+        for (; n != max && head_ != tail; ++n)
+        {
+            node* old_head = head_;
+            *out = std::move(*old_head->data_);
+            ++out;
+            head_ = old_head->next_;
+            delete old_head;
+        }
+
+        return n;
+    }
+
+    /// True if atomics of queue don`t fall back to locks on this platform
+    bool is_lock_free() const
+    {
+        return tail_.is_lock_free();
+    }
+
 private:
     struct node
     {
@@ -52,8 +127,13 @@ private:
         node* next_;
     };
 
+    // Consumer side
     node* head_;
+    char pad0_[cache_line_size];
+
+    // Producer side
     boost::atomic<node*> tail_;
+    char pad1_[cache_line_size];
 };
 
 }}
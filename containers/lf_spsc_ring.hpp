@@ -0,0 +1,212 @@
+#pragma once
+
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <memory>
+#include <new>
+
+namespace tcl { namespace containers {
+
+/// \brief Bounded single producer, single consumer lock-free queue.
+///
+/// Values are stored inline in preallocated ring of \c Capacity slots, so
+/// \c try_push and \c try_pop never touch allocator. Producer owns \c tail_,
+/// consumer owns \c head_. Each side keeps cached copy of the other side index
+/// and rereads shared one only when cached copy says that ring is full (empty).
+///
+/// \tparam Capacity - number of slots, must be power of two.
+/// \tparam Allocator - used once on construction to allocate slots.
+template<typename T, size_t Capacity, typename Allocator = std::allocator<T> >
+class lf_spsc_ring : Allocator::template rebind<T>::other
+{
+    BOOST_STATIC_ASSERT_MSG(
+        Capacity && !(Capacity & (Capacity - 1)), "Capacity must be power of two");
+
+    typedef typename Allocator::template rebind<T>::other value_allocator;
+
+    static const size_t mask = Capacity - 1;
+
+    lf_spsc_ring(const lf_spsc_ring&);
+    lf_spsc_ring& operator=(const lf_spsc_ring&);
+
+public:
+    lf_spsc_ring(const Allocator& allocator = Allocator())
+    : value_allocator(allocator)
+    , buffer_(value_allocator::allocate(Capacity))
+    , head_(0)
+    , cached_tail_(0)
+    , tail_(0)
+    , cached_head_(0)
+    {
+    }
+
+    ~lf_spsc_ring()
+    {
+        const size_t tail = tail_.load(boost::memory_order_relaxed);
+        for (size_t i = head_.load(boost::memory_order_relaxed); i != tail; ++i)
+            buffer_[i & mask].~T();
+
+        value_allocator::deallocate(buffer_, Capacity);
+    }
+
+    /// Must be called only from producer thread.
+    /// Return false if ring is full.
+    bool try_push(const T& value)
+    {
+        const size_t tail = tail_.load(boost::memory_order_relaxed);
+        if (tail - cached_head_ == Capacity)
+        {
+            cached_head_ = head_.load(boost::memory_order_acquire);
+            if (tail - cached_head_ == Capacity)
+                return false;
+        }
+
+        new (buffer_ + (tail & mask)) T(value);
+        tail_.store(tail + 1, boost::memory_order_release);
+
+        return true;
+    }
+
+    /// Must be called only from producer thread.
+    /// Yield while ring is full.
+    void push(const T& value)
+    {
+        while (!try_push(value))
+            boost::this_thread::yield();
+    }
+
+    /// Must be called only from producer thread.
+    /// Push values from [first, last) while there is free space and publish
+    /// them to consumer with single release store.
+    /// Return iterator to first value that was not pushed.
+    template<typename InputIterator>
+    InputIterator try_push_range(InputIterator first, InputIterator last)
+    {
+        const size_t tail = tail_.load(boost::memory_order_relaxed);
+        size_t new_tail = tail;
+
+        try
+        {
+            for (; first != last; ++first, ++new_tail)
+            {
+                if (new_tail - cached_head_ == Capacity)
+                {
+                    cached_head_ = head_.load(boost::memory_order_acquire);
+                    if (new_tail - cached_head_ == Capacity)
+                        break;
+                }
+
+                new (buffer_ + (new_tail & mask)) T(*first);
+            }
+        }
+        catch(...)
+        {
+            // Publish values that were constructed before exception
+            tail_.store(new_tail, boost::memory_order_release);
+            throw;
+        }
+
+        if (new_tail != tail)
+            tail_.store(new_tail, boost::memory_order_release);
+
+        return first;
+    }
+
+    /// Must be called only from producer thread.
+    /// Push all values from [first, last), yield while ring is full.
+    template<typename InputIterator>
+    void push_range(InputIterator first, InputIterator last)
+    {
+        while ((first = try_push_range(first, last)) != last)
+            boost::this_thread::yield();
+    }
+
+    /// Must be called only from consumer thread.
+    /// Return false if ring is empty.
+    bool try_pop(T& result)
+    {
+        const size_t head = head_.load(boost::memory_order_relaxed);
+        if (head == cached_tail_)
+        {
+            cached_tail_ = tail_.load(boost::memory_order_acquire);
+            if (head == cached_tail_)
+                return false;
+        }
+
+        T& slot = buffer_[head & mask];
+        result = std::move(slot);
+        slot.~T();
+        head_.store(head + 1, boost::memory_order_release);
+
+        return true;
+    }
+
+    /// Must be called only from consumer thread.
+    /// Move up to max values to out and release their slots to producer
+    /// with single release store. Return number of values popped.
+    template<typename OutputIterator>
+    size_t pop_n(OutputIterator out, size_t max)
+    {
+        const size_t head = head_.load(boost::memory_order_relaxed);
+        if (cached_tail_ - head < max)
+            cached_tail_ = tail_.load(boost::memory_order_acquire);
+
+        const size_t available = cached_tail_ - head;
+        const size_t n = available < max ? available : max;
+
+        size_t i = 0;
+        try
+        {
+            for (; i != n; ++i)
+            {
+                T& slot = buffer_[(head + i) & mask];
+                *out = std::move(slot);
+                ++out;
+                slot.~T();
+            }
+        }
+        catch(...)
+        {
+            // Slot that failed to move stays in ring
+            head_.store(head + i, boost::memory_order_release);
+            throw;
+        }
+
+        if (n)
+            head_.store(head + n, boost::memory_order_release);
+
+        return n;
+    }
+
+    static size_t capacity()
+    {
+        return Capacity;
+    }
+
+    /// True if atomics of ring don`t fall back to locks on this platform
+    bool is_lock_free() const
+    {
+        return head_.is_lock_free() && tail_.is_lock_free();
+    }
+
+private:
+    // Read-only after construction, shared by both sides
+    T* const buffer_;
+    char pad0_[cache_line_size];
+
+    // Consumer side
+    boost::atomic<size_t> head_;
+    size_t cached_tail_;
+    char pad1_[cache_line_size];
+
+    // Producer side
+    boost::atomic<size_t> tail_;
+    size_t cached_head_;
+    char pad2_[cache_line_size];
+};
+
+}}
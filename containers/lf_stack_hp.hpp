@@ -1,8 +1,12 @@
 #pragma once
 
+#include "elimination_array.hpp"
+#include "epoch_domain.hpp"
 #include "hazard_pointers.hpp"
 
 #include <tcl/allocators/construct_destroy.hpp>
+#include <tcl/cache_line.hpp>
+#include <tcl/statistics.hpp>
 
 #include <boost/atomic.hpp>
 
@@ -26,18 +30,27 @@ struct lf_stack_hp_node
 }
 
 /// \brief Lock-free stack, that use hazard pointers to reclaim free node.
-template<typename T, class Allocator = std::allocator<T>>
+///
+/// \tparam Elimination - \c no_elimination or \c elimination_array<>, the latter
+///                       lets colliding push and pop exchange value directly.
+/// \tparam Reclamation - \c hazard_pointers or \c epoch_domain, rebound to node type.
+template<
+    typename T
+  , class Allocator = std::allocator<T>
+  , typename Elimination = no_elimination
+  , typename Reclamation = hazard_pointers<void, 10>
+  >
 class lf_stack_hp : Allocator::template rebind<detail::lf_stack_hp_node<T> >::other
 {
     typedef detail::lf_stack_hp_node<T> node;
     typedef typename Allocator::template rebind<node>::other node_allocator;
 
-    typedef hazard_pointers<node, 10> hazard_pointers_type;
-
     lf_stack_hp(const lf_stack_hp&);
     lf_stack_hp& operator=(const lf_stack_hp&);
 
 public:
+    typedef typename Reclamation::template rebind<node>::other reclamation_type;
+
     lf_stack_hp(const Allocator& allocator = Allocator()) 
         : node_allocator(allocator)
         , head_(0) 
@@ -48,37 +61,83 @@ public:
     {
         node* new_node = allocators::construct(*(node_allocator*)this, value);
         new_node->next_ = head_.load(boost::memory_order_relaxed);
-        while(!head_.compare_exchange_weak(new_node->next_, new_node, boost::memory_order_release));
+        unsigned failures = 0;
+        while(!head_.compare_exchange_weak(new_node->next_, new_node, boost::memory_order_release))
+        {
+            ++failures;
+            if (elimination_.offer(new_node))
+                break;
+        }
+
+        stats_.operation(failures);
     }
 
     bool try_pop(T& result)
     {
-        node* old_head = head_.load(boost::memory_order_relaxed);
+        node* old_head;
+        unsigned failures = 0;
         {
-            typename hazard_pointers_type::scoped_allocator sa(hps_);
-            do {
-                sa.ref().store(old_head, boost::memory_order_relaxed);
-            } while(old_head && !head_.compare_exchange_weak(old_head, old_head->next_, boost::memory_order_release));
+            typename reclamation_type::guard g(reclamation_);
+            for(;;)
+            {
+                old_head = g.protect(head_);
+                if (!old_head || head_.compare_exchange_strong(old_head, old_head->next_, boost::memory_order_acquire))
+                    break;
+
+                ++failures;
+
+                // Node from elimination array was never published, nobody else can see it
+                if (node* eliminated = static_cast<node*>(elimination_.take()))
+                {
+                    result = std::move(eliminated->value_);
+                    allocators::destroy(*(node_allocator*)this, eliminated);
+                    stats_.operation(failures);
+                    return true;
+                }
+            }
         }
 
+        stats_.operation(failures);
+
         if (old_head)
         {
             result = std::move(old_head->value_);
-
-            if (hps_.outstanding_hp_for(old_head))
-                allocators::destroy(*(node_allocator*)this, old_head);
-            else
-                hps_.reclaim_later(old_head, (node_allocator&)*this);
-
+            reclamation_.reclaim_later(old_head, (node_allocator&)*this);
             return true;
         }
 
         return false;
     }
 
+    /// Reclamation domain of popped nodes
+    reclamation_type& reclamation()
+    {
+        return reclamation_;
+    }
+
+    /// CAS failures of push and pop together with reclamation counters,
+    /// zeros unless built with TCL_STATISTICS
+    statistics get_statistics() const
+    {
+        return stats_.get().merge(reclamation_.get_statistics());
+    }
+
+    /// True if atomics of stack don`t fall back to locks on this platform
+    bool is_lock_free() const
+    {
+        return head_.is_lock_free();
+    }
+
 private:
-    hazard_pointers_type hps_;
+    // Read by every operation, keep it apart from head
+    reclamation_type reclamation_;
+    char pad0_[cache_line_size];
+
     boost::atomic<node*> head_;
+    char pad1_[cache_line_size];
+
+    Elimination elimination_;
+    statistics_counters stats_;
 };
 
 }}
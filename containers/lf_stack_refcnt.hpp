@@ -1,6 +1,11 @@
 #pragma once
 
+#include "atomic_counted_ptr.hpp"
+#include "elimination_array.hpp"
+
 #include <tcl/allocators/construct_destroy.hpp>
+#include <tcl/cache_line.hpp>
+#include <tcl/statistics.hpp>
 
 #include <boost/atomic.hpp>
 
@@ -10,16 +15,6 @@ namespace tcl { namespace containers {
 
 namespace detail {
 
-template<typename T>
-struct lf_stack_refcnt_node;
-
-template<typename T>
-struct lf_stack_refcnt_counted_node_ptr
-{
-	int external_count_;
-	lf_stack_refcnt_node<T>* node_;
-};
-
 template<typename T>
 struct lf_stack_refcnt_node
 {
@@ -30,31 +25,41 @@ struct lf_stack_refcnt_node
 
 	boost::atomic_int internal_count_;
 	T value_;
-	lf_stack_refcnt_counted_node_ptr<T> next_;
+	counted_ptr<lf_stack_refcnt_node<T> > next_;
 };
 
 }
 
-template<typename T, typename Allocator = std::allocator<T> >
+/// \brief Lock-free stack, that use split reference counts to reclaim free node.
+///
+/// \tparam Elimination - \c no_elimination or \c elimination_array<>, the latter
+///                       lets colliding push and pop exchange value directly.
+template<typename T, typename Allocator = std::allocator<T>, typename Elimination = no_elimination>
 class lf_stack_refcnt : Allocator::template rebind<detail::lf_stack_refcnt_node<T> >::other
 {
     typedef detail::lf_stack_refcnt_node<T> node;
-    typedef detail::lf_stack_refcnt_counted_node_ptr<T> counted_node_ptr;
+    typedef counted_ptr<node> counted_node_ptr;
     typedef typename Allocator::template rebind<node>::other node_allocator;
 
-	void increase_head_count(counted_node_ptr& old_counter)
+	// Return number of failed CAS
+	unsigned increase_head_count(counted_node_ptr& old_counter)
 	{
 		counted_node_ptr new_counter;
+		unsigned failures = 0;
 
-		do {
+		for(;; ++failures)
+		{
 			new_counter = old_counter;
 			++new_counter.external_count_;
-		} while(!head_.compare_exchange_weak(old_counter,
+			if (head_.compare_exchange_weak(old_counter,
 											new_counter,
 											boost::memory_order_acquire,
-											boost::memory_order_relaxed));
+											boost::memory_order_relaxed))
+				break;
+		}
 
 		old_counter.external_count_ = new_counter.external_count_;
+		return failures;
 	}
 
 public:
@@ -72,45 +77,91 @@ public:
 		counted_node_ptr new_head;
         new_head.external_count_ = 1;
         new_head.node_ = allocators::construct(*(node_allocator*)this, val);
-		new_head.node_->next_ = head_.load(boost::memory_order_relaxed);
 
-		while (!head_.compare_exchange_weak(new_head.node_->next_,
+		// Node can`t be used as CAS argument, emulated boost::atomic writes
+		// expected value back even on success, when node may be already popped
+		counted_node_ptr old_head = head_.peek();
+		new_head.node_->next_ = old_head;
+
+		unsigned failures = 0;
+		while (!head_.compare_exchange_weak(old_head,
 											new_head,
 											boost::memory_order_release,
-											boost::memory_order_relaxed));
+											boost::memory_order_relaxed))
+		{
+			++failures;
+			if (elimination_.offer(new_head.node_))
+				break;
+
+			new_head.node_->next_ = old_head;
+		}
+
+		stats_.operation(failures);
 	}
 
 	bool try_pop(T& result)
 	{
-		counted_node_ptr old_head = head_.load(boost::memory_order_relaxed);
+		counted_node_ptr old_head = head_.peek();
+		unsigned failures = 0;
 
-		for(;;)
+		for(;; ++failures)
 		{
 			// lock head
-			increase_head_count(old_head);
+			failures += increase_head_count(old_head);
 			node* ptr = old_head.node_;
 
 			if (!ptr)
+			{
+				stats_.operation(failures);
 				return false;
+			}
 
 			if (head_.compare_exchange_strong(old_head, ptr->next_, boost::memory_order_relaxed))
 			{
                 result = std::move(ptr->value_);
 
-				const int count_increase = old_head.external_count_ - 2;
+				const int count_increase = static_cast<int>(old_head.external_count_ - 2);
 				if (ptr->internal_count_.fetch_add(count_increase, boost::memory_order_release) == -count_increase)
                     allocators::destroy(*(node_allocator*)this, ptr);
 
+				stats_.operation(failures);
 				return true;
 			}
 			else if (ptr->internal_count_.fetch_add(-1, boost::memory_order_relaxed) == 1)
-				boost::atomic_thread_fence(boost::memory_order_release);
+			{
+				ptr->internal_count_.load(boost::memory_order_acquire);
                 allocators::destroy(*(node_allocator*)this, ptr);
+			}
+
+			// Node from elimination array was never published, nobody else can see it
+			if (node* eliminated = static_cast<node*>(elimination_.take()))
+			{
+				result = std::move(eliminated->value_);
+				allocators::destroy(*(node_allocator*)this, eliminated);
+				stats_.operation(failures + 1);
+				return true;
+			}
 		}
 	}
 
+	/// CAS failures of push and pop, zeros unless built with TCL_STATISTICS
+	statistics get_statistics() const
+	{
+		return stats_.get();
+	}
+
+	/// True if atomics of stack don`t fall back to locks on this platform
+	bool is_lock_free() const
+	{
+		return head_.is_lock_free();
+	}
+
 private:
-	boost::atomic<counted_node_ptr> head_;
+	atomic_counted_ptr<node> head_;
+	char pad0_[cache_line_size];
+
+	Elimination elimination_;
+	statistics_counters stats_;
 };
 
 }}
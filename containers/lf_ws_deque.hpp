@@ -0,0 +1,245 @@
+#pragma once
+
+#include <tcl/allocators/construct_destroy.hpp>
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+namespace tcl { namespace containers {
+
+namespace detail {
+
+template<typename T>
+struct lf_ws_deque_array
+{
+    lf_ws_deque_array(size_t capacity, boost::atomic<T>* cells, lf_ws_deque_array* prev)
+        : mask_(capacity - 1)
+        , cells_(cells)
+        , prev_(prev)
+    {}
+
+    size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+    T get(ptrdiff_t i) const
+    {
+        return cells_[i & mask_].load(boost::memory_order_relaxed);
+    }
+
+    void put(ptrdiff_t i, const T& value)
+    {
+        cells_[i & mask_].store(value, boost::memory_order_relaxed);
+    }
+
+    const size_t mask_;
+    boost::atomic<T>* const cells_;
+    lf_ws_deque_array* prev_;           //!< Replaced arrays not freed yet, owner only
+};
+
+}
+
+/// \brief Chase-Lev work-stealing deque.
+///
+/// Owner thread pushes and pops at the bottom without locks and, unless deque
+/// is almost empty, without CAS. Any other thread can \c steal from the top
+/// with single CAS. Circular buffer grows when full; thieves may still read
+/// replaced buffer, so it is retired. Thieves count themselves while inside
+/// \c steal, and owner frees retired buffers in \c pop_bottom when it sees
+/// no thieves. Thief that comes later can only load the current buffer.
+///
+/// See "Correct and Efficient Work-Stealing for Weak Memory Models"
+/// by Le, Pop, Cohen and Zappa Nardelli.
+///
+/// \tparam T - must be trivially copyable, usually pointer to task.
+template<typename T, typename Allocator = std::allocator<T> >
+class lf_ws_deque : Allocator::template rebind<detail::lf_ws_deque_array<T> >::other
+{
+    typedef detail::lf_ws_deque_array<T> array;
+    typedef typename Allocator::template rebind<array>::other array_allocator;
+    typedef typename Allocator::template rebind<boost::atomic<T> >::other cell_allocator;
+
+    lf_ws_deque(const lf_ws_deque&);
+    lf_ws_deque& operator=(const lf_ws_deque&);
+
+public:
+    /// \param capacity - initial capacity, must be power of two.
+    lf_ws_deque(size_t capacity = 64, const Allocator& allocator = Allocator())
+        : array_allocator(allocator)
+        , top_(0)
+        , thieves_(0)
+        , bottom_(0)
+        , array_(create_array(capacity, 0))
+    {
+    }
+
+    ~lf_ws_deque()
+    {
+        array* a = array_.load(boost::memory_order_relaxed);
+        while (a)
+        {
+            array* prev = a->prev_;
+            destroy_array(a);
+            a = prev;
+        }
+    }
+
+    /// Must be called only from owner thread.
+    void push_bottom(const T& value)
+    {
+        const ptrdiff_t b = bottom_.load(boost::memory_order_relaxed);
+        const ptrdiff_t t = top_.load(boost::memory_order_acquire);
+        array* a = array_.load(boost::memory_order_relaxed);
+
+        if (b - t > static_cast<ptrdiff_t>(a->mask_))
+            a = grow(a, b, t);
+
+        a->put(b, value);
+        boost::atomic_thread_fence(boost::memory_order_release);
+        bottom_.store(b + 1, boost::memory_order_relaxed);
+    }
+
+    /// Must be called only from owner thread.
+    /// Return false if deque is empty.
+    bool pop_bottom(T& result)
+    {
+        const ptrdiff_t b = bottom_.load(boost::memory_order_relaxed) - 1;
+        array* a = array_.load(boost::memory_order_relaxed);
+        bottom_.store(b, boost::memory_order_relaxed);
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        ptrdiff_t t = top_.load(boost::memory_order_relaxed);
+
+        // Fence orders array_ store in grow before this load, thief orders
+        // its increment before loading array_ the same way
+        if (a->prev_ && !thieves_.load(boost::memory_order_acquire))
+            free_retired(a);
+
+        if (t > b)
+        {
+            bottom_.store(b + 1, boost::memory_order_relaxed);
+            return false;
+        }
+
+        result = a->get(b);
+        if (t == b)
+        {
+            // Last element, race with thieves for it
+            const bool won = top_.compare_exchange_strong(
+                t, t + 1, boost::memory_order_seq_cst, boost::memory_order_relaxed);
+            bottom_.store(b + 1, boost::memory_order_relaxed);
+            return won;
+        }
+
+        return true;
+    }
+
+    /// Can be called from any thread.
+    /// Return false if deque is empty or other thread won the race for top element.
+    bool steal(T& result)
+    {
+        // Owner doesn`t free replaced arrays while there are thieves
+        thieves_.fetch_add(1, boost::memory_order_relaxed);
+        const bool stolen = try_steal(result);
+        thieves_.fetch_sub(1, boost::memory_order_release);
+        return stolen;
+    }
+
+    /// Approximate number of elements
+    size_t size() const
+    {
+        const ptrdiff_t b = bottom_.load(boost::memory_order_relaxed);
+        const ptrdiff_t t = top_.load(boost::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    /// True if atomics of deque don`t fall back to locks on this platform
+    bool is_lock_free() const
+    {
+        return top_.is_lock_free() && array_.is_lock_free()
+            && array_.load(boost::memory_order_relaxed)->cells_[0].is_lock_free();
+    }
+
+private:
+    bool try_steal(T& result)
+    {
+        ptrdiff_t t = top_.load(boost::memory_order_acquire);
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        const ptrdiff_t b = bottom_.load(boost::memory_order_acquire);
+
+        if (t >= b)
+            return false;
+
+        array* a = array_.load(boost::memory_order_acquire);
+        const T value = a->get(t);
+        if (!top_.compare_exchange_strong(
+                t, t + 1, boost::memory_order_seq_cst, boost::memory_order_relaxed))
+            return false;
+
+        result = value;
+        return true;
+    }
+
+    array* grow(array* a, ptrdiff_t b, ptrdiff_t t)
+    {
+        array* new_array = create_array(a->capacity() * 2, a);
+        for (ptrdiff_t i = t; i != b; ++i)
+            new_array->put(i, a->get(i));
+
+        array_.store(new_array, boost::memory_order_release);
+        return new_array;
+    }
+
+    array* create_array(size_t capacity, array* prev)
+    {
+        assert("Ensure that capacity is power of two" && capacity && !(capacity & (capacity - 1)));
+
+        cell_allocator cells_allocator(*(array_allocator*)this);
+        boost::atomic<T>* cells = allocators::construct_array(cells_allocator, capacity);
+
+        try
+        {
+            return allocators::construct(*(array_allocator*)this, capacity, cells, prev);
+        }
+        catch(...)
+        {
+            allocators::destroy_array(cells_allocator, cells, capacity);
+            throw;
+        }
+    }
+
+    void free_retired(array* a)
+    {
+        array* r = a->prev_;
+        a->prev_ = 0;
+        while (r)
+        {
+            array* prev = r->prev_;
+            destroy_array(r);
+            r = prev;
+        }
+    }
+
+    void destroy_array(array* a)
+    {
+        cell_allocator cells_allocator(*(array_allocator*)this);
+        allocators::destroy_array(cells_allocator, a->cells_, a->capacity());
+        allocators::destroy(*(array_allocator*)this, a);
+    }
+
+    // Thieves side
+    boost::atomic<ptrdiff_t> top_;
+    boost::atomic<unsigned> thieves_;   //!< Threads inside steal
+    char pad0_[cache_line_size];
+
+    // Owner side
+    boost::atomic<ptrdiff_t> bottom_;
+    boost::atomic<array*> array_;
+    char pad1_[cache_line_size];
+};
+
+}}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "hazard_pointers.hpp"
+
+#include <tcl/allocators/construct_destroy.hpp>
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+
+#include <memory>
+
+namespace tcl { namespace containers {
+
+namespace detail {
+
+/// Retired versions are big and rare, so scan on every retire
+template<typename T, size_t Size, bool AsymmetricFence, bool BackgroundReclaim>
+void snapshot_cell_reclaim_eagerly(hazard_pointers<T, Size, AsymmetricFence, BackgroundReclaim>& domain)
+{
+    domain.set_max_outstanding(1);
+}
+
+/// Epoch domain frees by its Threshold, use epoch_domain<void, 1>
+template<typename Reclamation>
+void snapshot_cell_reclaim_eagerly(Reclamation&)
+{
+}
+
+}
+
+/// \brief Read-mostly cell that holds current version of immutable value.
+///
+/// Reader takes \c read_guard and sees one consistent version until guard
+/// ends. Guard costs one hazard pointer (or epoch announce) store, there is
+/// no shared reference counter, so readers don`t write to common cache line.
+/// Writer publishes new version with one atomic exchange and retires old one
+/// through reclamation domain, it is freed when the last reader that has
+/// seen it leaves. Hazard pointer domain scans on every retire, so old
+/// version is freed right away if nobody reads it.
+///
+/// \tparam Reclamation - hazard_pointers or epoch_domain, the latter with
+///                       Threshold 1 so that old versions don`t pile up.
+template<
+    typename T
+  , typename Allocator = std::allocator<T>
+  , typename Reclamation = hazard_pointers<void, 4>
+  >
+class snapshot_cell : Allocator::template rebind<T>::other
+{
+    typedef typename Allocator::template rebind<T>::other value_allocator;
+    typedef typename Reclamation::template rebind<T>::other reclamation_type;
+
+    snapshot_cell(const snapshot_cell&);
+    snapshot_cell& operator=(const snapshot_cell&);
+
+public:
+    /// \brief Current version for scope.
+    class read_guard
+    {
+    public:
+        explicit read_guard(snapshot_cell& cell)
+            : guard_(cell.reclamation_)
+            , value_(guard_.protect(cell.current_))
+        {
+        }
+
+        const T& operator*() const
+        {
+            return *value_;
+        }
+
+        const T* operator->() const
+        {
+            return value_;
+        }
+
+        const T* get() const
+        {
+            return value_;
+        }
+
+    private:
+        read_guard(const read_guard&);
+        read_guard& operator=(const read_guard&);
+
+        typename reclamation_type::guard guard_;
+        T* value_;
+    };
+
+    explicit snapshot_cell(const T& value = T(), const Allocator& allocator = Allocator())
+        : value_allocator(allocator)
+        , current_(allocators::construct(*(value_allocator*)this, value))
+    {
+        detail::snapshot_cell_reclaim_eagerly(reclamation_);
+    }
+
+    ~snapshot_cell()
+    {
+        allocators::destroy(*(value_allocator*)this, current_.load(boost::memory_order_relaxed));
+    }
+
+    /// Publish new version.
+    void store(const T& value)
+    {
+        T* new_value = allocators::construct(*(value_allocator*)this, value);
+        T* old_value = current_.exchange(new_value, boost::memory_order_acq_rel);
+        reclamation_.reclaim_later(old_value, (value_allocator&)*this);
+    }
+
+    /// Copy current version, apply f to the copy and publish it if nobody
+    /// else has published meanwhile, otherwise start over.
+    template<typename F>
+    void update(F f)
+    {
+        for(;;)
+        {
+            read_guard g(*this);
+            T* new_value = allocators::construct(*(value_allocator*)this, *g);
+            try
+            {
+                f(*new_value);
+            }
+            catch(...)
+            {
+                allocators::destroy(*(value_allocator*)this, new_value);
+                throw;
+            }
+
+            T* expected = const_cast<T*>(g.get());
+            if (current_.compare_exchange_strong(expected, new_value, boost::memory_order_acq_rel, boost::memory_order_relaxed))
+            {
+                reclamation_.reclaim_later(const_cast<T*>(g.get()), (value_allocator&)*this);
+                return;
+            }
+
+            allocators::destroy(*(value_allocator*)this, new_value);
+        }
+    }
+
+    /// True if current version pointer doesn`t fall back to lock
+    bool is_lock_free() const
+    {
+        return current_.is_lock_free();
+    }
+
+    /// Reclamation domain of old versions
+    reclamation_type& reclamation()
+    {
+        return reclamation_;
+    }
+
+private:
+    reclamation_type reclamation_;
+    char pad0_[cache_line_size];
+
+    boost::atomic<T*> current_;
+    char pad1_[cache_line_size];
+};
+
+}}
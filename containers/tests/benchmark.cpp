@@ -0,0 +1,464 @@
+#include "../lb_queue.hpp"
+#include "../lb_fg_queue.hpp"
+#include "../lb_stack.hpp"
+#include "../flat_combining.hpp"
+#include "../lf_spsc_queue.hpp"
+#include "../lf_spsc_ring.hpp"
+#include "../lf_mpmc_queue.hpp"
+#include "../lf_mpmc_ring.hpp"
+#include "../lf_mpmc_seg_queue.hpp"
+#include "../lf_stack_hp.hpp"
+#include "../lf_stack_refcnt.hpp"
+#include "../lf_ws_deque.hpp"
+#include "../epoch_domain.hpp"
+#include "../../allocators/fixed_allocator.hpp"
+#include "benchmark.hpp"
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/mpl/vector.hpp>
+#include <boost/mpl/for_each.hpp>
+#include <boost/mpl/placeholders.hpp>
+#include <boost/type_traits/add_pointer.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// Throughput of producer/consumer containers.
+//
+// Every container from the type list below runs for every payload size and
+// every producers x consumers combination up to --threads (powers of two and
+// the limit itself). Each run is warmed up, then ops are counted for
+// --duration milliseconds and repeated --repetitions times. One CSV line or
+// JSON object per repetition goes to stdout, so results of different versions
+// can be compared by script.
+//
+// Usage: tcl.containers.tests.benchmark [--threads N] [--duration MS[,MS...]]
+//          [--warmup MS] [--repetitions N] [--payload BYTES[,BYTES...]]
+//          [--filter SUBSTRING] [--format csv|json]
+
+typedef boost::chrono::steady_clock clock_type;
+
+using namespace std;
+using namespace tcl::containers;
+
+struct options
+{
+    options()
+        : threads_(std::max<int>(boost::thread::hardware_concurrency(), 1))
+        , durations_(1, 100)
+        , warmup_(20)
+        , repetitions_(3)
+        , json_(false)
+    {
+    }
+
+    int threads_;
+    std::vector<int> durations_;    //!< Milliseconds
+    int warmup_;                    //!< Milliseconds
+    int repetitions_;
+    std::vector<int> payloads_;     //!< Bytes, empty for all
+    std::string filter_;
+    bool json_;
+};
+
+std::vector<int> parse_list(const std::string& s)
+{
+    std::vector<int> result;
+    for (size_t begin = 0; begin <= s.size();)
+    {
+        size_t end = std::min(s.find(',', begin), s.size());
+        result.push_back(boost::lexical_cast<int>(s.substr(begin, end - begin)));
+        begin = end + 1;
+    }
+
+    return result;
+}
+
+bool parse_options(int argc, char* argv[], options& o)
+{
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string name = argv[i];
+        const std::string value = argv[i + 1];
+
+        if (name == "--threads")
+            o.threads_ = boost::lexical_cast<int>(value);
+        else if (name == "--duration")
+            o.durations_ = parse_list(value);
+        else if (name == "--warmup")
+            o.warmup_ = boost::lexical_cast<int>(value);
+        else if (name == "--repetitions")
+            o.repetitions_ = boost::lexical_cast<int>(value);
+        else if (name == "--payload")
+            o.payloads_ = parse_list(value);
+        else if (name == "--filter")
+            o.filter_ = value;
+        else if (name == "--format")
+            o.json_ = value == "json";
+        else
+            return false;
+    }
+
+    return argc % 2 == 1;
+}
+
+// Element of given size, copied in and out of containers by value
+template<size_t Size>
+struct payload
+{
+    static const size_t size = Size;
+
+    payload()
+    {
+        std::memset(data_, 0, Size);
+    }
+
+    char data_[Size];
+};
+
+typedef boost::mpl::vector<payload<8>, payload<64>, payload<256> > payloads;
+
+// Container descriptors, how many threads may push and pop, 0 is any number
+struct mpmc
+{
+    static const int max_producers = 0;
+    static const int max_consumers = 0;
+};
+
+struct spsc
+{
+    static const int max_producers = 1;
+    static const int max_consumers = 1;
+};
+
+struct spmc
+{
+    static const int max_producers = 1;
+    static const int max_consumers = 0;
+};
+
+// Gives work-stealing deque queue interface: owner pushes, thieves steal
+template<typename T>
+struct ws_deque_queue : lf_ws_deque<T>
+{
+    void push(const T& value) { this->push_bottom(value); }
+    bool try_pop(T& result) { return this->steal(result); }
+};
+
+#define TCL_BENCH_CONTAINER(descriptor, label, kind, ...)               \
+    struct descriptor : kind                                            \
+    {                                                                   \
+        static const char* name() { return label; }                     \
+        template<typename T> using type = __VA_ARGS__;                  \
+    };
+
+TCL_BENCH_CONTAINER(lb_queue_bench, "lb_queue", mpmc, lb_queue<T>)
+TCL_BENCH_CONTAINER(lb_fg_queue_bench, "lb_fg_queue", mpmc, lb_fg_queue<T, tcl::allocators::fixed_allocator<T, 10000>>)
+TCL_BENCH_CONTAINER(fc_queue_bench, "fc_queue", mpmc, fc_queue<T>)
+TCL_BENCH_CONTAINER(lf_spsc_queue_bench, "lf_spsc_queue", spsc, lf_spsc_queue<T>)
+TCL_BENCH_CONTAINER(lf_spsc_ring_bench, "lf_spsc_ring", spsc, lf_spsc_ring<T, 1024>)
+TCL_BENCH_CONTAINER(lf_mpmc_ring_bench, "lf_mpmc_ring", mpmc, lf_mpmc_ring<T, 1024>)
+TCL_BENCH_CONTAINER(lf_mpmc_queue_bench, "lf_mpmc_queue", mpmc, lf_mpmc_queue<T, tcl::allocators::fixed_allocator<T, 10000>>)
+TCL_BENCH_CONTAINER(lf_mpmc_seg_queue_bench, "lf_mpmc_seg_queue", mpmc, lf_mpmc_seg_queue<T>)
+TCL_BENCH_CONTAINER(lf_mpmc_seg_queue_epoch_bench, "lf_mpmc_seg_queue epoch", mpmc, lf_mpmc_seg_queue<T, 1024, std::allocator<T>, epoch_domain<void>>)
+TCL_BENCH_CONTAINER(lb_stack_bench, "lb_stack", mpmc, lb_stack<T>)
+TCL_BENCH_CONTAINER(fc_stack_bench, "fc_stack", mpmc, fc_stack<T>)
+TCL_BENCH_CONTAINER(lf_stack_hp_bench, "lf_stack_hp", mpmc, lf_stack_hp<T, tcl::allocators::fixed_allocator<T, 10000>>)
+TCL_BENCH_CONTAINER(lf_stack_hp_epoch_bench, "lf_stack_hp epoch", mpmc, lf_stack_hp<T, tcl::allocators::fixed_allocator<T, 10000>, no_elimination, epoch_domain<void>>)
+TCL_BENCH_CONTAINER(lf_stack_hp_elimination_bench, "lf_stack_hp elimination", mpmc, lf_stack_hp<T, tcl::allocators::fixed_allocator<T, 10000>, elimination_array<>>)
+TCL_BENCH_CONTAINER(lf_stack_refcnt_bench, "lf_stack_refcnt", mpmc, lf_stack_refcnt<T, tcl::allocators::fixed_allocator<T, 10000>>)
+TCL_BENCH_CONTAINER(lf_stack_refcnt_elimination_bench, "lf_stack_refcnt elimination", mpmc, lf_stack_refcnt<T, tcl::allocators::fixed_allocator<T, 10000>, elimination_array<>>)
+TCL_BENCH_CONTAINER(lf_ws_deque_bench, "lf_ws_deque", spmc, ws_deque_queue<T>)
+
+#undef TCL_BENCH_CONTAINER
+
+// New container is benchmarked once it is added here
+typedef boost::mpl::vector<
+    lb_queue_bench
+  , lb_fg_queue_bench
+  , fc_queue_bench
+  , lf_spsc_queue_bench
+  , lf_spsc_ring_bench
+  , lf_mpmc_ring_bench
+  , lf_mpmc_queue_bench
+  , lf_mpmc_seg_queue_bench
+  , lf_mpmc_seg_queue_epoch_bench
+  , lb_stack_bench
+  , fc_stack_bench
+  , lf_stack_hp_bench
+  , lf_stack_hp_epoch_bench
+  , lf_stack_hp_elimination_bench
+  , lf_stack_refcnt_bench
+  , lf_stack_refcnt_elimination_bench
+  , lf_ws_deque_bench
+  > containers;
+
+enum phase
+{
+    warmup,
+    measure,
+    stop
+};
+
+// Producers update in_flight_ once per batch and wait while it is too big,
+// otherwise unbounded containers grow without limit when consumers are slower
+const long batch_size = 256;
+const long max_in_flight = 1 << 16;
+
+struct run_state
+{
+    run_state(int producers) : phase_(warmup), producers_left_(producers), in_flight_(0)
+    {
+    }
+
+    boost::atomic<int> phase_;
+    boost::atomic<int> producers_left_;
+    boost::atomic<long> in_flight_;
+};
+
+template<typename Container, typename T>
+void producer_proc(Container& c, run_state& s, boost::barrier& b, size_t& ops)
+{
+    const T value;
+    size_t measured = 0;
+    long batch = 0;
+
+    b.wait();
+    for (int p; (p = s.phase_.load(boost::memory_order_relaxed)) != stop;)
+    {
+        c.push(value);
+        if (p == measure)
+            ++measured;
+
+        if (++batch == batch_size)
+        {
+            batch = 0;
+            s.in_flight_.fetch_add(batch_size, boost::memory_order_relaxed);
+            while (s.in_flight_.load(boost::memory_order_relaxed) > max_in_flight
+                && s.phase_.load(boost::memory_order_relaxed) != stop)
+                boost::this_thread::yield();
+        }
+    }
+
+    s.producers_left_.fetch_sub(1);
+    ops = measured;
+}
+
+// Keeps popping after stop until producers are done, producer may wait on full ring
+template<typename Container, typename T>
+void consumer_proc(Container& c, run_state& s, boost::barrier& b, size_t& ops)
+{
+    T value;
+    size_t measured = 0;
+    long batch = 0;
+
+    b.wait();
+    for (;;)
+    {
+        const int p = s.phase_.load(boost::memory_order_relaxed);
+        if (p == stop && !s.producers_left_.load())
+            break;
+
+        if (!c.try_pop(value))
+            continue;
+
+        if (p == measure)
+            ++measured;
+
+        if (++batch == batch_size)
+        {
+            batch = 0;
+            s.in_flight_.fetch_sub(batch_size, boost::memory_order_relaxed);
+        }
+    }
+
+    ops = measured;
+}
+
+struct result
+{
+    double push_rate_;  //!< ops/sec
+    double pop_rate_;   //!< ops/sec
+    const char* lock_free_;
+};
+
+template<typename Container, typename T>
+result run_once(int producers, int consumers, int duration, int warmup_duration)
+{
+    Container c;
+    run_state s(producers);
+    boost::barrier b(producers + consumers + 1);
+    std::vector<size_t> push_ops(producers);
+    std::vector<size_t> pop_ops(consumers);
+
+    std::vector<boost::thread> thrs;
+    for (int i = 0; i < producers; ++i)
+        thrs.push_back(boost::thread(&producer_proc<Container, T>, std::ref(c), std::ref(s), std::ref(b), std::ref(push_ops[i])));
+
+    for (int i = 0; i < consumers; ++i)
+        thrs.push_back(boost::thread(&consumer_proc<Container, T>, std::ref(c), std::ref(s), std::ref(b), std::ref(pop_ops[i])));
+
+    b.wait();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(warmup_duration));
+
+    clock_type::time_point tp1 = clock_type::now();
+    s.phase_.store(measure);
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(duration));
+    s.phase_.store(stop);
+    clock_type::time_point tp2 = clock_type::now();
+
+    for (size_t i = 0; i < thrs.size(); ++i)
+        thrs[i].join();
+
+    const double seconds = boost::chrono::duration<double>(tp2 - tp1).count();
+
+    result r;
+    r.push_rate_ = std::accumulate(push_ops.begin(), push_ops.end(), size_t(0)) / seconds;
+    r.pop_rate_ = std::accumulate(pop_ops.begin(), pop_ops.end(), size_t(0)) / seconds;
+    r.lock_free_ = lock_free_state(c, 0);
+    return r;
+}
+
+class reporter
+{
+public:
+    explicit reporter(bool json) : json_(json), rows_(0)
+    {
+        if (json_)
+            cout << "[" << endl;
+        else
+            cout << "container,payload,producers,consumers,duration_ms,repetition,lock_free,push_ops_per_sec,pop_ops_per_sec" << endl;
+    }
+
+    ~reporter()
+    {
+        if (json_)
+            cout << endl << "]" << endl;
+    }
+
+    void row(const char* container, size_t payload, int producers, int consumers, int duration, int repetition, const result& r)
+    {
+        cout.setf(ios::fixed);
+        cout.precision(0);
+
+        if (json_)
+        {
+            cout << (rows_ ? ",\n" : "")
+                 << "  {\"container\": \"" << container << "\""
+                 << ", \"payload\": " << payload
+                 << ", \"producers\": " << producers
+                 << ", \"consumers\": " << consumers
+                 << ", \"duration_ms\": " << duration
+                 << ", \"repetition\": " << repetition
+                 << ", \"lock_free\": \"" << r.lock_free_ << "\""
+                 << ", \"push_ops_per_sec\": " << r.push_rate_
+                 << ", \"pop_ops_per_sec\": " << r.pop_rate_ << "}";
+        }
+        else
+        {
+            cout << container << "," << payload << "," << producers << "," << consumers << ","
+                 << duration << "," << repetition << "," << r.lock_free_ << ","
+                 << r.push_rate_ << "," << r.pop_rate_ << endl;
+        }
+
+        ++rows_;
+    }
+
+private:
+    bool json_;
+    size_t rows_;
+};
+
+// 1, 2, 4, ... below limit and limit itself
+std::vector<int> thread_counts(int max_threads, int limit)
+{
+    if (limit)
+        max_threads = std::min(max_threads, limit);
+
+    std::vector<int> result;
+    for (int n = 1; n < max_threads; n *= 2)
+        result.push_back(n);
+
+    result.push_back(max_threads);
+    return result;
+}
+
+template<typename Descriptor>
+struct run_payloads
+{
+    run_payloads(const options& o, reporter& r) : options_(o), reporter_(r)
+    {
+    }
+
+    template<typename T>
+    void operator()(T*) const
+    {
+        const std::vector<int>& sizes = options_.payloads_;
+        if (!sizes.empty() && std::find(sizes.begin(), sizes.end(), int(T::size)) == sizes.end())
+            return;
+
+        typedef typename Descriptor::template type<T> container;
+
+        const std::vector<int> producers = thread_counts(options_.threads_, Descriptor::max_producers);
+        const std::vector<int> consumers = thread_counts(options_.threads_, Descriptor::max_consumers);
+
+        for (size_t d = 0; d < options_.durations_.size(); ++d)
+            for (size_t p = 0; p < producers.size(); ++p)
+                for (size_t c = 0; c < consumers.size(); ++c)
+                    for (int rep = 1; rep <= options_.repetitions_; ++rep)
+                    {
+                        const result r = run_once<container, T>(
+                            producers[p], consumers[c], options_.durations_[d], options_.warmup_);
+
+                        reporter_.row(Descriptor::name(), T::size, producers[p], consumers[c], options_.durations_[d], rep, r);
+                    }
+    }
+
+    const options& options_;
+    reporter& reporter_;
+};
+
+struct run_container
+{
+    run_container(const options& o, reporter& r) : options_(o), reporter_(r)
+    {
+    }
+
+    template<typename Descriptor>
+    void operator()(Descriptor*) const
+    {
+        if (std::string(Descriptor::name()).find(options_.filter_) == std::string::npos)
+            return;
+
+        boost::mpl::for_each<payloads, boost::add_pointer<boost::mpl::_1> >(
+            run_payloads<Descriptor>(options_, reporter_));
+    }
+
+    const options& options_;
+    reporter& reporter_;
+};
+
+int main(int argc, char* argv[])
+{
+    options o;
+    if (!parse_options(argc, argv, o))
+    {
+        cerr << "Usage: " << argv[0]
+             << " [--threads N] [--duration MS[,MS...]] [--warmup MS] [--repetitions N]"
+                " [--payload BYTES[,BYTES...]] [--filter SUBSTRING] [--format csv|json]" << endl;
+        return 1;
+    }
+
+    reporter r(o.json_);
+    boost::mpl::for_each<containers, boost::add_pointer<boost::mpl::_1> >(run_container(o, r));
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <tcl/statistics.hpp>
+
+#include <iostream>
+
+// "yes" or "no" for lock-free containers, atomics of which may fall back to locks
+template<typename Container>
+auto lock_free_state(const Container& c, int) -> decltype(c.is_lock_free(), (const char*)0)
+{
+    return c.is_lock_free() ? "yes" : "no";
+}
+
+template<typename Container>
+const char* lock_free_state(const Container&, long)
+{
+    return "lock-based";
+}
+
+template<typename Container>
+void print_lock_free(const Container& c, const char* name)
+{
+    std::cout << name << " lock-free: " << lock_free_state(c, 0) << std::endl;
+}
+
+// Contention and reclamation counters of containers that keep them,
+// printed only when built with TCL_STATISTICS
+template<typename Container>
+auto print_statistics(const Container& c, const char* name, int) -> decltype(c.get_statistics(), void())
+{
+#if defined(TCL_STATISTICS)
+    const tcl::statistics s = c.get_statistics();
+    std::cout << name << " statistics:"
+        << " ops " << s.operations_
+        << " cas failures/op " << s.cas_failures_per_operation()
+        << " scans " << s.scans_
+        << " freed/scan " << s.freed_per_scan()
+        << " retired high-water " << s.retired_high_water_ << std::endl;
+#else
+    (void)c;
+    (void)name;
+#endif
+}
+
+template<typename Container>
+void print_statistics(const Container&, const char*, long)
+{
+}
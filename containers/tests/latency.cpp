@@ -0,0 +1,324 @@
+#include "../lf_spsc_queue.hpp"
+#include "../lf_mpmc_queue.hpp"
+#include "../lb_queue.hpp"
+#include "../lb_fg_queue.hpp"
+#include "../../allocators/fixed_allocator.hpp"
+
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+// Round trip latency of queues.
+//
+// Ping thread pushes timestamp to one queue, echo thread pops it and pushes
+// it back through another queue of the same type, ping thread records time
+// elapsed since timestamp. Both threads are pinned to given cpus, so numbers
+// are not polluted by migrations. With --noise, one more thread keeps
+// pushing and popping its own elements on the ping queue, which shows how
+// the tail grows under contention. Single producer/single consumer queues
+// can`t be shared with third thread and run without noise.
+//
+// Usage: tcl.containers.tests.latency [--cpus PING,ECHO[,NOISE]]
+//          [--messages N] [--warmup N] [--noise 0|1]
+
+typedef boost::chrono::steady_clock clock_type;
+typedef boost::int64_t message;
+
+using namespace std;
+using namespace tcl::containers;
+
+const message noise_marker = -1;
+const int max_noise_markers = 64;
+const int spins_before_yield = 1000;
+
+struct options
+{
+    options()
+        : messages_(100000)
+        , warmup_(10000)
+        , noise_(false)
+    {
+        const int cores = std::max<int>(boost::thread::hardware_concurrency(), 1);
+        cpus_.push_back(0);
+        cpus_.push_back(1 % cores);
+        cpus_.push_back(2 % cores);
+    }
+
+    std::vector<int> cpus_;     //!< Ping, echo and noise threads
+    int messages_;
+    int warmup_;
+    bool noise_;
+};
+
+bool parse_options(int argc, char* argv[], options& o)
+{
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string name = argv[i];
+        const std::string value = argv[i + 1];
+
+        if (name == "--cpus")
+        {
+            std::vector<int> cpus;
+            for (size_t begin = 0; begin <= value.size();)
+            {
+                size_t end = std::min(value.find(',', begin), value.size());
+                cpus.push_back(boost::lexical_cast<int>(value.substr(begin, end - begin)));
+                begin = end + 1;
+            }
+
+            std::copy(cpus.begin(), cpus.begin() + std::min(cpus.size(), o.cpus_.size()), o.cpus_.begin());
+        }
+        else if (name == "--messages")
+            o.messages_ = boost::lexical_cast<int>(value);
+        else if (name == "--warmup")
+            o.warmup_ = boost::lexical_cast<int>(value);
+        else if (name == "--noise")
+            o.noise_ = value == "1";
+        else
+            return false;
+    }
+
+    return argc % 2 == 1;
+}
+
+/// Pin calling thread to cpu, false if it is not supported or cpu doesn`t exist
+bool pin_to_cpu(int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return !sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+message now_ns()
+{
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+        clock_type::now().time_since_epoch()).count();
+}
+
+/// \brief Log-linear histogram in the spirit of HdrHistogram.
+///
+/// Values below 2^SubBucketBits are counted exactly, bigger ones are grouped
+/// by highest set bit and every group is split into 2^(SubBucketBits - 1)
+/// equal buckets, so relative error is below 2^(1 - SubBucketBits) for any
+/// magnitude and memory doesn`t depend on value range.
+template<unsigned SubBucketBits = 7>
+class latency_histogram
+{
+    static const boost::uint64_t sub_buckets = boost::uint64_t(1) << SubBucketBits;
+    static const boost::uint64_t half = sub_buckets / 2;
+
+public:
+    latency_histogram()
+        : counts_(sub_buckets + (64 - SubBucketBits) * half)
+        , total_(0)
+        , max_(0)
+    {
+    }
+
+    void record(boost::uint64_t value)
+    {
+        ++counts_[index(value)];
+        ++total_;
+        max_ = std::max(max_, value);
+    }
+
+    /// Highest value of bucket where percentile falls
+    boost::uint64_t percentile(double p) const
+    {
+        const boost::uint64_t rank = std::max<boost::uint64_t>(
+            static_cast<boost::uint64_t>(std::ceil(p / 100 * total_)), 1);
+
+        boost::uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i)
+        {
+            seen += counts_[i];
+            if (seen >= rank)
+                return std::min(upper(i), max_);
+        }
+
+        return max_;
+    }
+
+    boost::uint64_t max() const
+    {
+        return max_;
+    }
+
+private:
+    static size_t index(boost::uint64_t value)
+    {
+        if (value < sub_buckets)
+            return static_cast<size_t>(value);
+
+        unsigned msb = SubBucketBits;
+        while (value >> (msb + 1))
+            ++msb;
+
+        // Top SubBucketBits bits of value, the highest one is always set
+        const unsigned shift = msb - SubBucketBits + 1;
+        return static_cast<size_t>(sub_buckets + (shift - 1) * half + (value >> shift) - half);
+    }
+
+    static boost::uint64_t upper(size_t i)
+    {
+        if (i < sub_buckets)
+            return i;
+
+        const unsigned shift = static_cast<unsigned>((i - sub_buckets) / half) + 1;
+        const boost::uint64_t top = (i - sub_buckets) % half + half;
+        return ((top + 1) << shift) - 1;
+    }
+
+    std::vector<boost::uint64_t> counts_;
+    boost::uint64_t total_;
+    boost::uint64_t max_;
+};
+
+template<typename Queue>
+void wait_pop(Queue& q, message& m)
+{
+    // Yield now and then, otherwise on machine with few cores spinning
+    // thread burns whole time slice while its peer is not scheduled
+    for (int spins = 0; !q.try_pop(m); ++spins)
+    {
+        if (spins == spins_before_yield)
+        {
+            spins = 0;
+            boost::this_thread::yield();
+        }
+    }
+}
+
+template<typename Queue>
+void echo_proc(Queue& ping, Queue& pong, boost::atomic<int>& markers, int count, int cpu)
+{
+    pin_to_cpu(cpu);
+    for (int i = 0; i < count;)
+    {
+        message m;
+        wait_pop(ping, m);
+        if (m == noise_marker)
+        {
+            markers.fetch_sub(1, boost::memory_order_relaxed);
+            continue;
+        }
+
+        pong.push(m);
+        ++i;
+    }
+}
+
+// Pushes and pops own markers on ping queue, ping message taken by
+// mistake goes back to queue
+template<typename Queue>
+void noise_proc(Queue& ping, boost::atomic<bool>& stop, boost::atomic<int>& markers, int cpu)
+{
+    pin_to_cpu(cpu);
+    while (!stop.load(boost::memory_order_relaxed))
+    {
+        if (markers.load(boost::memory_order_relaxed) < max_noise_markers)
+        {
+            markers.fetch_add(1, boost::memory_order_relaxed);
+            ping.push(noise_marker);
+        }
+
+        message m;
+        if (ping.try_pop(m))
+        {
+            if (m == noise_marker)
+                markers.fetch_sub(1, boost::memory_order_relaxed);
+            else
+                ping.push(m);
+        }
+    }
+}
+
+template<typename Queue>
+void ping_proc(Queue& ping, Queue& pong, const options& o, latency_histogram<>& h, bool& pinned)
+{
+    pinned = pin_to_cpu(o.cpus_[0]);
+    for (int i = 0; i < o.warmup_ + o.messages_; ++i)
+    {
+        ping.push(now_ns());
+
+        message m;
+        wait_pop(pong, m);
+
+        if (i >= o.warmup_)
+            h.record(static_cast<boost::uint64_t>(now_ns() - m));
+    }
+}
+
+template<typename Queue>
+void do_latency_test(const char* name, const options& o, bool noise)
+{
+    Queue ping;
+    Queue pong;
+    boost::atomic<bool> stop(false);
+    boost::atomic<int> markers(0);
+    latency_histogram<> h;
+    bool pinned = false;
+
+    boost::thread noise_thr;
+    if (noise)
+        noise_thr = boost::thread(&noise_proc<Queue>, std::ref(ping), std::ref(stop), std::ref(markers), o.cpus_[2]);
+
+    boost::thread echo_thr(&echo_proc<Queue>, std::ref(ping), std::ref(pong), std::ref(markers), o.warmup_ + o.messages_, o.cpus_[1]);
+    boost::thread ping_thr(&ping_proc<Queue>, std::ref(ping), std::ref(pong), std::cref(o), std::ref(h), std::ref(pinned));
+
+    ping_thr.join();
+    echo_thr.join();
+
+    stop.store(true);
+    if (noise)
+        noise_thr.join();
+
+    cout << name << (noise ? " with noise" : "") << " round trip ns:"
+         << " p50 " << h.percentile(50)
+         << " p99 " << h.percentile(99)
+         << " p99.9 " << h.percentile(99.9)
+         << " max " << h.max()
+         << (pinned ? "" : " (not pinned)") << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    options o;
+    if (!parse_options(argc, argv, o))
+    {
+        cerr << "Usage: " << argv[0] << " [--cpus PING,ECHO[,NOISE]] [--messages N] [--warmup N] [--noise 0|1]" << endl;
+        return 1;
+    }
+
+    cout << "cpus: ping " << o.cpus_[0] << " echo " << o.cpus_[1];
+    if (o.noise_)
+        cout << " noise " << o.cpus_[2];
+
+    cout << " messages: " << o.messages_ << endl;
+
+    do_latency_test<lf_spsc_queue<message>>("lf_spsc_queue", o, false);
+    do_latency_test<lf_mpmc_queue<message, tcl::allocators::fixed_allocator<message, 10000>>>("lf_mpmc_queue", o, o.noise_);
+    do_latency_test<lb_queue<message>>("lb_queue", o, o.noise_);
+    do_latency_test<lb_fg_queue<message, tcl::allocators::fixed_allocator<message, 10000>>>("lb_fg_queue", o, o.noise_);
+
+    return 0;
+}
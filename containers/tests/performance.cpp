@@ -2,10 +2,22 @@
 #include "../lb_stack.hpp"
 #include "../lf_stack_refcnt.hpp"
 #include "../lf_spsc_queue.hpp"
+#include "../lf_spsc_ring.hpp"
 #include "../lf_mpmc_queue.hpp"
+#include "../lf_mpmc_ring.hpp"
+#include "../lf_mpmc_seg_queue.hpp"
 #include "../lb_queue.hpp"
 #include "../lb_fg_queue.hpp"
+#include "../lf_ws_deque.hpp"
+#include "../flat_combining.hpp"
+#include "../lf_hash_map.hpp"
+#include "../lf_skiplist_map.hpp"
+#include "../snapshot_cell.hpp"
+#include "../waitable_queue.hpp"
 #include "../../allocators/fixed_allocator.hpp"
+#include "benchmark.hpp"
+
+#include <tcl/perf_counters.hpp>
 
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
@@ -14,13 +26,22 @@
 #include <boost/chrono/chrono.hpp>
 #include <boost/chrono/chrono_io.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 typedef boost::chrono::steady_clock clock_type;
 const int NUM_ATTEMPTS = 10000;
 
 boost::mutex g_log_guard;
 
+// Print hardware counters per operation, set by --perf
+bool g_perf = false;
+
 using namespace std;
 using namespace tcl::containers;
 
@@ -39,8 +60,10 @@ using namespace tcl::containers;
 template<typename Container>
 void measured_pop_proc(Container& c, boost::barrier& b, const char* name)
 {
+    tcl::perf_counters perf(g_perf);
     b.wait();
     clock_type::time_point tp1 = clock_type::now();
+    perf.start();
 	int total = 0;
 	for(int i = 0; i<NUM_ATTEMPTS;)
 	{
@@ -49,30 +72,66 @@ void measured_pop_proc(Container& c, boost::barrier& b, const char* name)
             ++i;
         ++total;
 	}
+    perf.stop();
 
     clock_type::time_point tp2 = clock_type::now();
 
 	boost::mutex::scoped_lock l(g_log_guard);
-	cout << name << " pop: " << tp2 - tp1 << " total pops: " << total << endl;
+	cout << name << " pop: " << tp2 - tp1 << " total pops: " << total;
+	perf.print_per_op(cout, NUM_ATTEMPTS);
+	cout << endl;
+}
+
+template<typename Container>
+void measured_wait_pop_proc(Container& c, boost::barrier& b, const char* name)
+{
+    tcl::perf_counters perf(g_perf);
+    b.wait();
+    clock_type::time_point tp1 = clock_type::now();
+    perf.start();
+    for(int i = 0; i<NUM_ATTEMPTS; ++i)
+    {
+        int value;
+        c.wait_pop(value);
+    }
+    perf.stop();
+
+    clock_type::time_point tp2 = clock_type::now();
+
+    boost::mutex::scoped_lock l(g_log_guard);
+    cout << name << " wait_pop: " << tp2 - tp1;
+    perf.print_per_op(cout, NUM_ATTEMPTS);
+    cout << endl;
 }
 
 template<typename Container>
 void measured_push_proc(Container& c, boost::barrier& b, const char* name)
 {
+    tcl::perf_counters perf(g_perf);
     b.wait();
     clock_type::time_point tp1 = clock_type::now();
+    perf.start();
 	for(int i = 0; i<NUM_ATTEMPTS; ++i)
 		c.push(i);
+    perf.stop();
 
     clock_type::time_point tp2 = clock_type::now();
 	boost::mutex::scoped_lock l(g_log_guard);
-	cout << name << " push: " << tp2 - tp1 << endl;
+	cout << name << " push: " << tp2 - tp1;
+	perf.print_per_op(cout, NUM_ATTEMPTS);
+	cout << endl;
 }
 
 template<typename Container>
-void do_test(const char* name, int push_threads, int pop_threads)
+void run_test(
+    const char* name
+  , int push_threads
+  , int pop_threads
+  , void (*pop_proc)(Container&, boost::barrier&, const char*)
+  )
 { 
     Container c;
+    print_lock_free(c, name);
     boost::barrier b(push_threads + pop_threads);
 
     std::vector<boost::thread> thrs;
@@ -80,24 +139,487 @@ void do_test(const char* name, int push_threads, int pop_threads)
         thrs.push_back(boost::thread(&measured_push_proc<Container>, std::ref(c), std::ref(b), name));
 
     for(int i = 0; i<pop_threads; ++i)
-        thrs.push_back(boost::thread(&measured_pop_proc<Container>, std::ref(c), std::ref(b), name));
+        thrs.push_back(boost::thread(pop_proc, std::ref(c), std::ref(b), name));
 
     for(int i = 0; i<push_threads + pop_threads; ++i)
         thrs[i].join();
+
+    print_statistics(c, name, 0);
+}
+
+template<typename Container>
+void do_test(const char* name, int push_threads, int pop_threads)
+{
+    run_test<Container>(name, push_threads, pop_threads, &measured_pop_proc<Container>);
+}
+
+template<typename Container>
+void do_wait_test(const char* name, int push_threads, int pop_threads)
+{
+    run_test<Container>(name, push_threads, pop_threads, &measured_wait_pop_proc<Container>);
+}
+
+template<typename Container>
+void measured_pop_n_proc(Container& c, boost::barrier& b, size_t batch, const char* name)
+{
+    std::vector<int> values(batch);
+
+    tcl::perf_counters perf(g_perf);
+    b.wait();
+    clock_type::time_point tp1 = clock_type::now();
+    perf.start();
+    int total = 0;
+    for(int i = 0; i<NUM_ATTEMPTS; ++total)
+        i += c.pop_n(values.begin(), std::min<size_t>(batch, NUM_ATTEMPTS - i));
+    perf.stop();
+
+    clock_type::time_point tp2 = clock_type::now();
+
+    boost::mutex::scoped_lock l(g_log_guard);
+    cout << name << " pop_n: " << tp2 - tp1 << " total pops: " << total;
+    perf.print_per_op(cout, NUM_ATTEMPTS);
+    cout << endl;
+}
+
+template<typename Container>
+void measured_push_range_proc(Container& c, boost::barrier& b, size_t batch, const char* name)
+{
+    std::vector<int> values(batch);
+
+    tcl::perf_counters perf(g_perf);
+    b.wait();
+    clock_type::time_point tp1 = clock_type::now();
+    perf.start();
+    for(int i = 0; i<NUM_ATTEMPTS; )
+    {
+        const size_t n = std::min<size_t>(batch, NUM_ATTEMPTS - i);
+        for(size_t k = 0; k<n; ++k)
+            values[k] = i++;
+
+        c.push_range(values.begin(), values.begin() + n);
+    }
+    perf.stop();
+
+    clock_type::time_point tp2 = clock_type::now();
+    boost::mutex::scoped_lock l(g_log_guard);
+    cout << name << " push_range: " << tp2 - tp1;
+    perf.print_per_op(cout, NUM_ATTEMPTS);
+    cout << endl;
+}
+
+template<typename Container>
+void do_batch_test(const char* name, size_t batch)
+{
+    Container c;
+    print_lock_free(c, name);
+    boost::barrier b(2);
+
+    boost::thread push_thr(&measured_push_range_proc<Container>, std::ref(c), std::ref(b), batch, name);
+    boost::thread pop_thr(&measured_pop_n_proc<Container>, std::ref(c), std::ref(b), batch, name);
+
+    push_thr.join();
+    pop_thr.join();
+}
+
+template<typename Container>
+void push_pop_proc(Container& c, boost::barrier& b, const char* name)
+{
+    tcl::perf_counters perf(g_perf);
+    b.wait();
+    clock_type::time_point tp1 = clock_type::now();
+    perf.start();
+    for(int i = 0; i<NUM_ATTEMPTS; ++i)
+    {
+        int value;
+        c.push(i);
+        c.try_pop(value);
+    }
+    perf.stop();
+
+    clock_type::time_point tp2 = clock_type::now();
+    boost::mutex::scoped_lock l(g_log_guard);
+    cout << name << " thread push/pop: " << tp2 - tp1;
+    perf.print_per_op(cout, NUM_ATTEMPTS * 2);
+    cout << endl;
+}
+
+// Every thread pushes and pops in turn, total time for 1..cores threads
+template<typename Container>
+void do_scaling_test(const char* name)
+{
+    const int max_threads = std::max<int>(boost::thread::hardware_concurrency(), 1);
+    for(int threads = 1; threads<=max_threads; ++threads)
+    {
+        Container c;
+        if (threads == 1)
+            print_lock_free(c, name);
+
+        boost::barrier b(threads + 1);
+
+        std::vector<boost::thread> thrs;
+        for(int i = 0; i<threads; ++i)
+            thrs.push_back(boost::thread(&push_pop_proc<Container>, std::ref(c), std::ref(b), name));
+
+        // Workers may be done before this thread wakes up, so start the clock first
+        clock_type::time_point tp1 = clock_type::now();
+        b.wait();
+        for(int i = 0; i<threads; ++i)
+            thrs[i].join();
+
+        clock_type::time_point tp2 = clock_type::now();
+        cout << name << " threads: " << threads << " push/pop: " << tp2 - tp1 << endl;
+        print_statistics(c, name, 0);
+    }
+}
+
+// Gives mutex guarded std::map or std::unordered_map lf_hash_map interface
+template<typename Map>
+class lb_map
+{
+    typedef typename Map::key_type key_type;
+    typedef typename Map::mapped_type mapped_type;
+
+public:
+    bool insert(const key_type& key, const mapped_type& value)
+    {
+        boost::mutex::scoped_lock lock(guard_);
+        return map_.insert(std::make_pair(key, value)).second;
+    }
+
+    bool find(const key_type& key, mapped_type& result)
+    {
+        boost::mutex::scoped_lock lock(guard_);
+        typename Map::const_iterator it = map_.find(key);
+        if (it == map_.end())
+            return false;
+
+        result = it->second;
+        return true;
+    }
+
+    bool erase(const key_type& key)
+    {
+        boost::mutex::scoped_lock lock(guard_);
+        return map_.erase(key) != 0;
+    }
+
+private:
+    boost::mutex guard_;
+    Map map_;
+};
+
+const int MAP_KEYS = 10000;
+
+template<typename Map>
+void map_proc(Map& m, boost::barrier& b, const char* name, int find_percent, unsigned seed)
+{
+    tcl::perf_counters perf(g_perf);
+    b.wait();
+    clock_type::time_point tp1 = clock_type::now();
+    perf.start();
+    for(int i = 0; i<NUM_ATTEMPTS * 10; ++i)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        const int key = seed % MAP_KEYS;
+        const int op = (seed / MAP_KEYS) % 100;
+
+        int value;
+        if (op < find_percent)
+            m.find(key, value);
+        else if (op & 1)
+            m.insert(key, i);
+        else
+            m.erase(key);
+    }
+    perf.stop();
+
+    clock_type::time_point tp2 = clock_type::now();
+    boost::mutex::scoped_lock l(g_log_guard);
+    cout << name << " " << find_percent << "% find thread: " << tp2 - tp1;
+    perf.print_per_op(cout, NUM_ATTEMPTS * 10);
+    cout << endl;
+}
+
+// Half of keys are in map, threads mix finds with equal number of inserts and erases
+template<typename Map>
+void do_map_test(const char* name, int find_percent)
+{
+    const int threads = std::max<int>(boost::thread::hardware_concurrency(), 2);
+
+    Map m;
+    print_lock_free(m, name);
+    for(int i = 0; i<MAP_KEYS; i += 2)
+        m.insert(i, i);
+
+    boost::barrier b(threads + 1);
+
+    std::vector<boost::thread> thrs;
+    for(int i = 0; i<threads; ++i)
+        thrs.push_back(boost::thread(&map_proc<Map>, std::ref(m), std::ref(b), name, find_percent, 2463534242u + i));
+
+    clock_type::time_point tp1 = clock_type::now();
+    b.wait();
+    for(int i = 0; i<threads; ++i)
+        thrs[i].join();
+
+    clock_type::time_point tp2 = clock_type::now();
+    cout << name << " " << find_percent << "% find threads: " << threads << ": " << tp2 - tp1 << endl;
+}
+
+// Gives std::shared_ptr with atomic_load and atomic_store snapshot_cell interface
+template<typename T>
+class shared_ptr_cell
+{
+public:
+    class read_guard
+    {
+    public:
+        explicit read_guard(shared_ptr_cell& cell) : value_(std::atomic_load(&cell.current_)) {}
+
+        const T& operator*() const { return *value_; }
+        const T* operator->() const { return value_.get(); }
+
+    private:
+        std::shared_ptr<const T> value_;
+    };
+
+    explicit shared_ptr_cell(const T& value) : current_(std::make_shared<T>(value)) {}
+
+    void store(const T& value)
+    {
+        std::atomic_store(&current_, std::shared_ptr<const T>(std::make_shared<T>(value)));
+    }
+
+private:
+    std::shared_ptr<const T> current_;
+};
+
+typedef std::vector<int> routing_table;
+
+template<typename Cell>
+void snapshot_reader_proc(Cell& c, boost::barrier& b, boost::atomic<int>& readers, const char* name)
+{
+    tcl::perf_counters perf(g_perf);
+    b.wait();
+    clock_type::time_point tp1 = clock_type::now();
+    perf.start();
+    int sum = 0;
+    for(int i = 0; i<NUM_ATTEMPTS * 100; ++i)
+    {
+        typename Cell::read_guard g(c);
+        sum += (*g)[i % g->size()];
+    }
+    perf.stop();
+
+    clock_type::time_point tp2 = clock_type::now();
+    readers.fetch_sub(1);
+
+    boost::mutex::scoped_lock l(g_log_guard);
+    cout << name << " read: " << tp2 - tp1 << " sum: " << sum;
+    perf.print_per_op(cout, NUM_ATTEMPTS * 100);
+    cout << endl;
+}
+
+template<typename Cell>
+void snapshot_writer_proc(Cell& c, boost::barrier& b, boost::atomic<int>& readers, const char* name)
+{
+    b.wait();
+    routing_table table(64, 1);
+    int versions = 0;
+    for(; readers.load(); ++versions)
+    {
+        table[versions % table.size()] = versions;
+        c.store(table);
+        boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+    }
+
+    boost::mutex::scoped_lock l(g_log_guard);
+    cout << name << " versions: " << versions << endl;
+}
+
+// Readers read routing table, while writer publishes new one every 100 microseconds
+template<typename Cell>
+void do_snapshot_test(const char* name, int readers)
+{
+    Cell c(routing_table(64, 1));
+    print_lock_free(c, name);
+    boost::barrier b(readers + 1);
+    boost::atomic<int> active(readers);
+
+    std::vector<boost::thread> thrs;
+    for(int i = 0; i<readers; ++i)
+        thrs.push_back(boost::thread(&snapshot_reader_proc<Cell>, std::ref(c), std::ref(b), std::ref(active), name));
+
+    snapshot_writer_proc(c, b, active, name);
+    for(int i = 0; i<readers; ++i)
+        thrs[i].join();
+}
+
+// Gives lb_stack work-stealing deque interface, thieves pop from the same end
+template<typename T>
+struct lb_stack_deque : lb_stack<T>
+{
+    void push_bottom(const T& value) { this->push(value); }
+    bool pop_bottom(T& result) { return this->try_pop(result); }
+    bool steal(T& result) { return this->try_pop(result); }
+};
+
+template<typename Deque>
+void measured_owner_proc(Deque& d, boost::barrier& b, boost::atomic<int>& consumed, const char* name)
+{
+    tcl::perf_counters perf(g_perf);
+    b.wait();
+    clock_type::time_point tp1 = clock_type::now();
+    perf.start();
+    int pops = 0;
+    int value;
+    for(int i = 0; i<NUM_ATTEMPTS; ++i)
+    {
+        d.push_bottom(i);
+
+        // Owner takes back only every 4th task, the rest is left for thieves
+        if (3 == i % 4 && d.pop_bottom(value))
+        {
+            ++pops;
+            consumed.fetch_add(1, boost::memory_order_relaxed);
+        }
+    }
+
+    while (d.pop_bottom(value))
+    {
+        ++pops;
+        consumed.fetch_add(1, boost::memory_order_relaxed);
+    }
+    perf.stop();
+
+    clock_type::time_point tp2 = clock_type::now();
+
+    boost::mutex::scoped_lock l(g_log_guard);
+    cout << name << " owner: " << tp2 - tp1 << " pops: " << pops;
+    perf.print_per_op(cout, NUM_ATTEMPTS);
+    cout << endl;
+}
+
+template<typename Deque>
+void measured_thief_proc(Deque& d, boost::barrier& b, boost::atomic<int>& consumed, const char* name)
+{
+    tcl::perf_counters perf(g_perf);
+    b.wait();
+    clock_type::time_point tp1 = clock_type::now();
+    perf.start();
+    int steals = 0;
+    int total = 0;
+    while (consumed.load(boost::memory_order_relaxed) < NUM_ATTEMPTS)
+    {
+        int value;
+        if (d.steal(value))
+        {
+            ++steals;
+            consumed.fetch_add(1, boost::memory_order_relaxed);
+        }
+        ++total;
+    }
+    perf.stop();
+
+    clock_type::time_point tp2 = clock_type::now();
+
+    boost::mutex::scoped_lock l(g_log_guard);
+    cout << name << " thief: " << tp2 - tp1 << " steals: " << steals << " total steals: " << total;
+    perf.print_per_op(cout, total);
+    cout << endl;
+}
+
+template<typename Deque>
+void do_steal_test(const char* name, int thieves)
+{
+    Deque d;
+    print_lock_free(d, name);
+    boost::barrier b(thieves + 1);
+    boost::atomic<int> consumed(0);
+
+    std::vector<boost::thread> thrs;
+    thrs.push_back(boost::thread(&measured_owner_proc<Deque>, std::ref(d), std::ref(b), std::ref(consumed), name));
+
+    for(int i = 0; i<thieves; ++i)
+        thrs.push_back(boost::thread(&measured_thief_proc<Deque>, std::ref(d), std::ref(b), std::ref(consumed), name));
+
+    for(int i = 0; i<thieves + 1; ++i)
+        thrs[i].join();
 }
 
 int main(int argc, char* argv[])
 {
-    //do_spsc_test<lf_spsc_queue<int>>("lf_spsc_queue spsc");
+    g_perf = argc > 1 && std::string(argv[1]) == "--perf";
+    if (g_perf)
+    {
+        tcl::perf_counters perf;
+        perf.print_availability(cout);
+        cout << endl;
+    }
+
+    do_test<lf_spsc_queue<int>>("lf_spsc_queue spsc", 1, 1);
+    do_test<lf_spsc_ring<int, 1024>>("lf_spsc_ring spsc", 1, 1);
+    do_batch_test<lf_spsc_queue<int>>("lf_spsc_queue spsc batch 64", 64);
+    do_batch_test<lf_spsc_ring<int, 1024>>("lf_spsc_ring spsc batch 64", 64);
+
+    do_test<lb_queue<int>>("lb_queue mpmc", 2, 2);
+    do_test<lb_fg_queue<int, tcl::allocators::fixed_allocator<int, 10000>>>("lb_fg_queue mpmc", 2, 2);
+    do_test<fc_queue<int>>("fc_queue mpmc", 2, 2);
 
-    do_test<lb_queue<int>>("lb_queue spsc", 2, 2);
-    do_test<lb_fg_queue<int, tcl::allocators::fixed_allocator<int, 10000>>>("lb_fg_queue spsc", 2, 2);
+    do_test<lf_mpmc_ring<int, 1024>>("lf_mpmc_ring mpmc", 2, 2);
+    do_test<lf_mpmc_queue<int, tcl::allocators::fixed_allocator<int, 10000>>>("lf_mpmc_queue mpmc", 2, 2);
+    do_test<lf_mpmc_seg_queue<int>>("lf_mpmc_seg_queue mpmc", 2, 2);
+    do_test<lf_mpmc_seg_queue<int, 1024, std::allocator<int>, epoch_domain<void>>>("lf_mpmc_seg_queue epoch mpmc", 2, 2);
 
-    do_test<lf_mpmc_queue<int, tcl::allocators::fixed_allocator<int, 10000>>>("lb_fg_queue spsc", 2, 2);
+    do_wait_test<waitable_queue<lf_spsc_queue<int>>>("lf_spsc_queue spsc blocking", 1, 1);
+    do_wait_test<waitable_queue<lf_spsc_ring<int, 1024>>>("lf_spsc_ring spsc blocking", 1, 1);
+    do_wait_test<waitable_queue<lb_queue<int>>>("lb_queue blocking", 2, 2);
+    do_wait_test<waitable_queue<lb_fg_queue<int, tcl::allocators::fixed_allocator<int, 10000>>>>("lb_fg_queue blocking", 2, 2);
+    do_wait_test<waitable_queue<fc_queue<int>>>("fc_queue blocking", 2, 2);
+    do_wait_test<waitable_queue<lf_mpmc_ring<int, 1024>>>("lf_mpmc_ring blocking", 2, 2);
+    do_wait_test<waitable_queue<lf_mpmc_queue<int, tcl::allocators::fixed_allocator<int, 10000>>>>("lf_mpmc_queue blocking", 2, 2);
+    do_wait_test<waitable_queue<lf_mpmc_seg_queue<int>>>("lf_mpmc_seg_queue blocking", 2, 2);
 
     do_test<lb_stack<int>>("lb_stack", 2, 2);
+    do_test<fc_stack<int>>("fc_stack", 2, 2);
     do_test<lf_stack_hp<int, tcl::allocators::fixed_allocator<int, 10000>>>("lf_stack_hp", 2, 2);
+    do_test<lf_stack_hp<int, tcl::allocators::fixed_allocator<int, 10000>, no_elimination, epoch_domain<void>>>("lf_stack_hp epoch", 2, 2);
+
+    cout << "asymmetric fence: " << (asymmetric_fence::is_asymmetric() ? "membarrier" : "fallback to full fence") << endl;
+    do_test<lf_stack_hp<int, tcl::allocators::fixed_allocator<int, 10000>, no_elimination, hazard_pointers<void, 10, true>>>("lf_stack_hp asymmetric fence", 2, 2);
+    do_test<lf_stack_hp<int, tcl::allocators::fixed_allocator<int, 10000>, no_elimination, hazard_pointers<void, 10, false, true>>>("lf_stack_hp background reclaim", 2, 2);
     do_test<lf_stack_refcnt<int, tcl::allocators::fixed_allocator<int, 10000>>>("lf_stack_refcnt", 2, 2);
+    do_test<lf_stack_hp<int, tcl::allocators::fixed_allocator<int, 10000>, elimination_array<>>>("lf_stack_hp elimination", 2, 2);
+    do_test<lf_stack_refcnt<int, tcl::allocators::fixed_allocator<int, 10000>, elimination_array<>>>("lf_stack_refcnt elimination", 2, 2);
+
+    do_scaling_test<lb_stack<int>>("lb_stack scaling");
+    do_scaling_test<fc_stack<int>>("fc_stack scaling");
+    do_scaling_test<lf_stack_hp<int, tcl::allocators::fixed_allocator<int, 10000>>>("lf_stack_hp scaling");
+    do_scaling_test<lf_stack_hp<int, tcl::allocators::fixed_allocator<int, 10000>, elimination_array<>>>("lf_stack_hp elimination scaling");
+    do_scaling_test<lf_stack_hp<int, tcl::allocators::fixed_allocator<int, 10000>, no_elimination, epoch_domain<void>>>("lf_stack_hp epoch scaling");
+    do_scaling_test<lf_stack_hp<int, tcl::allocators::fixed_allocator<int, 10000>, no_elimination, hazard_pointers<void, 10, true>>>("lf_stack_hp asymmetric fence scaling");
+    do_scaling_test<lf_stack_hp<int, tcl::allocators::fixed_allocator<int, 10000>, no_elimination, hazard_pointers<void, 10, false, true>>>("lf_stack_hp background reclaim scaling");
+    do_scaling_test<lf_stack_refcnt<int, tcl::allocators::fixed_allocator<int, 10000>>>("lf_stack_refcnt scaling");
+    do_scaling_test<lf_stack_refcnt<int, tcl::allocators::fixed_allocator<int, 10000>, elimination_array<>>>("lf_stack_refcnt elimination scaling");
+
+    do_map_test<lb_map<std::unordered_map<int, int>>>("lb_hash_map", 95);
+    do_map_test<lf_hash_map<int, int, boost::hash<int>, std::equal_to<int>, tcl::allocators::fixed_allocator<int, 10000>>>("lf_hash_map", 95);
+    do_map_test<lb_map<std::unordered_map<int, int>>>("lb_hash_map", 50);
+    do_map_test<lf_hash_map<int, int, boost::hash<int>, std::equal_to<int>, tcl::allocators::fixed_allocator<int, 10000>>>("lf_hash_map", 50);
+    do_map_test<lb_map<std::map<int, int>>>("lb_map", 95);
+    do_map_test<lf_skiplist_map<int, int>>("lf_skiplist_map", 95);
+    do_map_test<lb_map<std::map<int, int>>>("lb_map", 50);
+    do_map_test<lf_skiplist_map<int, int>>("lf_skiplist_map", 50);
+
+    do_snapshot_test<shared_ptr_cell<routing_table>>("shared_ptr atomic_load", 2);
+    do_snapshot_test<snapshot_cell<routing_table>>("snapshot_cell", 2);
+    do_snapshot_test<snapshot_cell<routing_table, std::allocator<routing_table>, epoch_domain<void, 1>>>("snapshot_cell epoch", 2);
+
+    do_steal_test<lb_stack_deque<int>>("lb_stack steal", 3);
+    do_steal_test<lf_ws_deque<int>>("lf_ws_deque steal", 3);
 
 	return 0;
 }
@@ -0,0 +1,286 @@
+// Stress tests for interleavings that are too rare to show up in benchmarks.
+//
+// Usage: tcl.containers.tests.stress
+// Returns non zero if any test fails. Build with -fsanitize=address to
+// catch use after free.
+
+#include "../epoch_domain.hpp"
+#include "../lf_stack_hp.hpp"
+#include "../lf_ws_deque.hpp"
+#include "../snapshot_cell.hpp"
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace std;
+using namespace tcl::containers;
+
+typedef std::shared_ptr<lf_stack_hp<int> > stack_ptr;
+
+void exit_reader_proc(snapshot_cell<stack_ptr>& cell, boost::barrier& b)
+{
+    {
+        snapshot_cell<stack_ptr>::read_guard g(cell);
+        int value;
+        (*g)->push(1);
+        (*g)->try_pop(value);
+        b.wait();   // version is protected
+        b.wait();   // writer has retired it
+    }
+
+    b.wait();       // version is released
+}
+
+void exit_writer_proc(snapshot_cell<stack_ptr>& cell, boost::barrier& b)
+{
+    b.wait();
+    cell.store(stack_ptr(new lf_stack_hp<int>));
+    b.wait();
+    b.wait();
+
+    // Old version is freed by exit hook of this thread and it destroys
+    // the stack together with its reclamation domain
+}
+
+// Thread exit hook frees object that owns other reclamation domain
+bool exit_hook_frees_domain_test()
+{
+    snapshot_cell<stack_ptr> cell(stack_ptr(new lf_stack_hp<int>));
+    boost::barrier b(2);
+
+    boost::thread reader(&exit_reader_proc, std::ref(cell), std::ref(b));
+    boost::thread writer(&exit_writer_proc, std::ref(cell), std::ref(b));
+
+    const bool ok = reader.try_join_for(boost::chrono::seconds(10))
+        && writer.try_join_for(boost::chrono::seconds(10));
+
+    cout << "snapshot_cell exit hook frees domain: " << (ok ? "ok" : "FAILED, deadlock") << endl;
+
+    if (!ok)
+    {
+        // Threads are stuck, nothing to clean up
+        reader.detach();
+        writer.detach();
+        std::_Exit(1);
+    }
+
+    return ok;
+}
+
+const int TOUCHED_DOMAINS = 64;
+
+typedef std::vector<std::unique_ptr<lf_stack_hp<int> > > stacks;
+
+/// Takes record of current thread in every stack when destroyed
+struct touch_on_destroy
+{
+    explicit touch_on_destroy(stacks& s) : stacks_(s) {}
+
+    ~touch_on_destroy()
+    {
+        for (size_t i = 0; i < stacks_.size(); ++i)
+        {
+            int value;
+            stacks_[i]->push(1);
+            stacks_[i]->try_pop(value);
+        }
+    }
+
+    stacks& stacks_;
+};
+
+typedef std::shared_ptr<touch_on_destroy> touch_ptr;
+
+void touch_reader_proc(snapshot_cell<touch_ptr>& cell, boost::barrier& b)
+{
+    {
+        snapshot_cell<touch_ptr>::read_guard g(cell);
+        b.wait();   // version is protected
+        b.wait();   // writer has retired it
+    }
+
+    b.wait();       // version is released
+}
+
+void touch_writer_proc(snapshot_cell<touch_ptr>& cell, boost::barrier& b, stacks& s)
+{
+    b.wait();
+    cell.store(touch_ptr(new touch_on_destroy(s)));
+    b.wait();
+    b.wait();
+
+    // Exit hook of this thread frees old version, and it takes records in
+    // domains this thread never used, so hooks are added while they run
+}
+
+// Thread exit hook takes records in other reclamation domains
+bool exit_hook_adds_records_test()
+{
+    stacks s;
+    for (int i = 0; i < TOUCHED_DOMAINS; ++i)
+        s.push_back(std::unique_ptr<lf_stack_hp<int> >(new lf_stack_hp<int>));
+
+    {
+        snapshot_cell<touch_ptr> cell(touch_ptr(new touch_on_destroy(s)));
+        boost::barrier b(2);
+
+        boost::thread reader(&touch_reader_proc, std::ref(cell), std::ref(b));
+        boost::thread writer(&touch_writer_proc, std::ref(cell), std::ref(b), std::ref(s));
+        reader.join();
+        writer.join();
+    }
+
+    // Records taken on exit were released by their own hooks
+    bool ok = true;
+    for (int i = 0; i < TOUCHED_DOMAINS; ++i)
+    {
+        int value;
+        s[i]->push(1);
+        ok &= s[i]->try_pop(value);
+    }
+
+    cout << "snapshot_cell exit hook adds records: " << (ok ? "ok" : "FAILED") << endl;
+    return ok;
+}
+
+/// Counts nodes freed through it
+struct counting_allocator : std::allocator<int>
+{
+    explicit counting_allocator(boost::atomic<int>& freed) : freed_(freed) {}
+
+    void deallocate(int* p, size_t n)
+    {
+        freed_.fetch_add(1);
+        std::allocator<int>::deallocate(p, n);
+    }
+
+    boost::atomic<int>& freed_;
+};
+
+const int EXITED_RETIRED = 10;
+
+void epoch_retire_proc(epoch_domain<int>& domain, counting_allocator& allocator)
+{
+    for (int i = 0; i < EXITED_RETIRED; ++i)
+        domain.reclaim_later(allocator.allocate(1), allocator);
+}
+
+// Garbage of exited thread is freed by survivors, not by domain destructor
+bool epoch_exit_orphans_test()
+{
+    boost::atomic<int> exited_freed(0);
+    boost::atomic<int> survivor_freed(0);
+    counting_allocator exited_allocator(exited_freed);
+    counting_allocator survivor_allocator(survivor_freed);
+
+    int freed = 0;
+    {
+        epoch_domain<int> domain;
+
+        // Own record, so that this thread doesn`t take the one of exited
+        domain.reclaim_later(survivor_allocator.allocate(1), survivor_allocator);
+
+        boost::thread t(&epoch_retire_proc, std::ref(domain), std::ref(exited_allocator));
+        t.join();
+
+        // Enough retires to advance epoch several times
+        for (int i = 0; i < 1000; ++i)
+            domain.reclaim_later(survivor_allocator.allocate(1), survivor_allocator);
+
+        freed = exited_freed.load();
+    }
+
+    const bool ok = freed == EXITED_RETIRED;
+    cout << "epoch_domain exited thread garbage: " << (ok ? "ok" : "FAILED")
+         << " freed before domain destruction " << freed << " of " << EXITED_RETIRED << endl;
+
+    return ok;
+}
+
+const int WS_THIEVES = 3;
+const int WS_ROUNDS = 200;
+const int WS_VALUES = 1000;         //!< Pushed by owner every round
+
+void ws_thief_proc(lf_ws_deque<int>& d, boost::atomic<bool>& stop, boost::atomic<long>& sum, boost::atomic<int>& count)
+{
+    while (!stop.load())
+    {
+        int value;
+        if (d.steal(value))
+        {
+            sum.fetch_add(value);
+            count.fetch_add(1);
+        }
+    }
+}
+
+// Owner frees replaced buffers while thieves keep stealing. Every round
+// starts with small buffer, so it grows and retires buffers again.
+bool ws_deque_retired_buffers_test()
+{
+    long expected = 0;
+    boost::atomic<long> sum(0);
+    boost::atomic<int> count(0);
+
+    for (int round = 0; round < WS_ROUNDS; ++round)
+    {
+        lf_ws_deque<int> d(2);
+        boost::atomic<bool> stop(false);
+
+        vector<boost::thread> thieves;
+        for (int i = 0; i < WS_THIEVES; ++i)
+            thieves.push_back(boost::thread(&ws_thief_proc, std::ref(d), std::ref(stop), std::ref(sum), std::ref(count)));
+
+        for (int i = 1; i <= WS_VALUES; ++i)
+        {
+            d.push_bottom(i);
+            expected += i;
+
+            int value;
+            if (i % 3 == 0 && d.pop_bottom(value))
+            {
+                sum.fetch_add(value);
+                count.fetch_add(1);
+            }
+
+            // Let thieves run between grows on machines with few cores
+            if (i % 64 == 0)
+                boost::this_thread::yield();
+        }
+
+        int value;
+        while (d.pop_bottom(value))
+        {
+            sum.fetch_add(value);
+            count.fetch_add(1);
+        }
+
+        stop.store(true);
+        for (size_t i = 0; i < thieves.size(); ++i)
+            thieves[i].join();
+    }
+
+    const bool ok = sum.load() == expected && count.load() == WS_ROUNDS * WS_VALUES;
+    cout << "lf_ws_deque retired buffers: " << (ok ? "ok" : "FAILED")
+         << " values " << count.load() << " of " << WS_ROUNDS * WS_VALUES << endl;
+
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+
+    ok &= exit_hook_frees_domain_test();
+    ok &= exit_hook_adds_records_test();
+    ok &= epoch_exit_orphans_test();
+    ok &= ws_deque_retired_buffers_test();
+
+    return ok ? 0 : 1;
+}
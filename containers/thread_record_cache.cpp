@@ -0,0 +1,177 @@
+#include "thread_record_cache.hpp"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace tcl { namespace containers { namespace detail {
+
+namespace {
+
+struct hook
+{
+    boost::uint64_t id_;
+    void* record_;
+    void* owner_;
+    thread_record_cache::exit_callback on_exit_;
+};
+
+struct owner_state
+{
+    owner_state() : closed_(false), pins_(0)
+    {
+    }
+
+    bool closed_;       //!< Owner is being destroyed, no new exit hooks
+    unsigned pins_;     //!< Exit hooks running on owner right now
+};
+
+/// Owners that are alive, guarded by mutex
+struct owners
+{
+    boost::mutex guard_;
+    boost::condition_variable unpinned_;
+    std::map<boost::uint64_t, owner_state> states_;
+    boost::uint64_t last_id_;
+};
+
+owners& get_owners()
+{
+    // Never destroyed, threads may exit after static destructors
+    static owners* o = new owners();
+    return *o;
+}
+
+/// Owner whose exit hook runs on this thread, 0 if none
+thread_local boost::uint64_t g_running_owner = 0;
+
+}
+
+/// All records of current thread, calls exit callbacks in destructor
+struct thread_record_registry
+{
+    /// Mutex is held only to pin owner, hooks run without it. Hook may free
+    /// objects that own other domains, and they unregister while it runs.
+    /// Hook may also take record in other domain, which appends new hook,
+    /// so hooks are walked by index and not pruned until the end.
+    ~thread_record_registry()
+    {
+        owners& o = get_owners();
+        exiting_ = true;
+
+        for (size_t i = 0; i < hooks_.size(); ++i)
+        {
+            const hook h = hooks_[i];
+            {
+                boost::lock_guard<boost::mutex> g(o.guard_);
+                std::map<boost::uint64_t, owner_state>::iterator s = o.states_.find(h.id_);
+                if (s == o.states_.end() || s->second.closed_)
+                    continue;
+
+                ++s->second.pins_;
+            }
+
+            g_running_owner = h.id_;
+            h.on_exit_(h.owner_, h.record_);
+            g_running_owner = 0;
+
+            boost::lock_guard<boost::mutex> g(o.guard_);
+            std::map<boost::uint64_t, owner_state>::iterator s = o.states_.find(h.id_);
+            if (s != o.states_.end())
+            {
+                --s->second.pins_;
+                o.unpinned_.notify_all();
+            }
+        }
+    }
+
+    /// Drop hooks of destroyed owners
+    void prune()
+    {
+        owners& o = get_owners();
+        boost::lock_guard<boost::mutex> g(o.guard_);
+
+        std::vector<hook>::iterator e = hooks_.begin();
+        for (std::vector<hook>::iterator it = hooks_.begin(); it != hooks_.end(); ++it)
+        {
+            std::map<boost::uint64_t, owner_state>::const_iterator s = o.states_.find(it->id_);
+            if (s != o.states_.end() && !s->second.closed_)
+                *e++ = *it;
+        }
+
+        hooks_.erase(e, hooks_.end());
+        prune_size_ = std::max<size_t>(2 * hooks_.size(), 16);
+    }
+
+    std::vector<hook> hooks_;
+    size_t prune_size_ = 16;
+    bool exiting_ = false;
+};
+
+namespace {
+
+thread_local thread_record_registry g_registry;
+
+}
+
+void* thread_record_cache::find_slow(boost::uint64_t id)
+{
+    for (std::vector<hook>::const_iterator it = g_registry.hooks_.begin(); it != g_registry.hooks_.end(); ++it)
+    {
+        if (it->id_ == id)
+        {
+            entry& e = lookup(id);
+            e.id_ = id;
+            e.record_ = it->record_;
+            return it->record_;
+        }
+    }
+
+    return 0;
+}
+
+void thread_record_cache::add(boost::uint64_t id, void* record, void* owner, exit_callback on_exit)
+{
+    if (!g_registry.exiting_ && g_registry.hooks_.size() >= g_registry.prune_size_)
+        g_registry.prune();
+
+    hook h = {id, record, owner, on_exit};
+    g_registry.hooks_.push_back(h);
+
+    entry& e = lookup(id);
+    e.id_ = id;
+    e.record_ = record;
+}
+
+boost::uint64_t thread_record_cache::register_owner()
+{
+    owners& o = get_owners();
+    boost::lock_guard<boost::mutex> g(o.guard_);
+
+    const boost::uint64_t id = ++o.last_id_;
+    o.states_[id];
+    return id;
+}
+
+void thread_record_cache::unregister_owner(boost::uint64_t id)
+{
+    owners& o = get_owners();
+    boost::unique_lock<boost::mutex> g(o.guard_);
+
+    owner_state& s = o.states_[id];
+    s.closed_ = true;
+
+    // Wait for hooks running on other threads. Hook running on this thread
+    // destroys its own owner, it can`t be waited for.
+    const unsigned own = g_running_owner == id ? 1 : 0;
+    while (s.pins_ > own)
+        o.unpinned_.wait(g);
+
+    o.states_.erase(id);
+}
+
+}}}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#include <cstddef>
+
+namespace tcl { namespace containers { namespace detail {
+
+/// \brief Per thread registry of per thread records.
+///
+/// Objects that keep a record for each thread (flat combining, reclamation
+/// domains) get unique id from \c register_owner and store pointer to the
+/// record of current thread under that id. Ids are never reused, so entry
+/// left by destroyed object never matches. Lookup goes to small direct mapped
+/// cache first and then to the list of all records of the thread.
+///
+/// When thread exits, it calls \c on_exit of every record whose owner is
+/// still registered. Owner unregisters before destroying records and waits
+/// for \c on_exit calls on its records that are already running, so
+/// \c on_exit never sees destroyed owner. Registration takes global mutex,
+/// exit takes it only to pin owner around every \c on_exit call, and
+/// lookups don`t take it at all. So exits of threads don`t serialize on
+/// hooks, and hook may destroy objects that own other records or take new
+/// records in other owners.
+///
+/// boost::thread_specific_ptr is not used since its key is object address,
+/// which can be reused.
+struct thread_record_cache
+{
+    typedef void (*exit_callback)(void* owner, void* record);
+
+    static const size_t size = 8;
+
+    struct entry
+    {
+        boost::uint64_t id_;
+        void* record_;
+    };
+
+    /// Record of current thread for owner \c id, 0 if there is none
+    static void* find(boost::uint64_t id)
+    {
+        entry& e = lookup(id);
+        if (e.id_ == id)
+            return e.record_;
+
+        return find_slow(id);
+    }
+
+    /// Remember record of current thread for owner \c id
+    static void add(boost::uint64_t id, void* record, void* owner, exit_callback on_exit);
+
+    static boost::uint64_t register_owner();
+    static void unregister_owner(boost::uint64_t id);
+
+private:
+    static entry& lookup(boost::uint64_t id)
+    {
+        static thread_local entry entries[size] = {};
+        return entries[id & (size - 1)];
+    }
+
+    static void* find_slow(boost::uint64_t id);
+};
+
+/// \brief Lock-free list of per thread records, grows when new thread comes.
+///
+/// Record must be default constructible and have members \c in_use_
+/// (boost::atomic<bool>) and \c next_. Record of exited thread is released
+/// and taken by next thread that comes. Records are deleted with the list.
+template<typename Record>
+class thread_record_list
+{
+    thread_record_list(const thread_record_list&);
+    thread_record_list& operator=(const thread_record_list&);
+
+public:
+    /// Called on exiting thread just before its record is released
+    typedef void (*exit_hook)(Record& record, void* context);
+
+    explicit thread_record_list(exit_hook hook = 0, void* context = 0)
+        : id_(thread_record_cache::register_owner())
+        , hook_(hook)
+        , context_(context)
+        , head_(0)
+        , size_(0)
+    {
+    }
+
+    ~thread_record_list()
+    {
+        close();
+
+        Record* r = head_.load(boost::memory_order_relaxed);
+        while (r)
+        {
+            Record* next = r->next_;
+            delete r;
+            r = next;
+        }
+    }
+
+    /// Stop handling thread exits. Owner calls it before it starts
+    /// to tear down records content, after that no hook is running.
+    void close()
+    {
+        if (id_)
+        {
+            thread_record_cache::unregister_owner(id_);
+            id_ = 0;
+        }
+    }
+
+    /// Record of current thread
+    Record& local()
+    {
+        if (void* r = thread_record_cache::find(id_))
+            return *static_cast<Record*>(r);
+
+        // Take record released by exited thread or add new one
+        Record* r = head();
+        for (; r; r = r->next_)
+        {
+            bool in_use = false;
+            if (!r->in_use_.load(boost::memory_order_relaxed) &&
+                r->in_use_.compare_exchange_strong(in_use, true, boost::memory_order_acquire, boost::memory_order_relaxed))
+                break;
+        }
+
+        if (!r)
+        {
+            r = new Record;
+            r->in_use_.store(true, boost::memory_order_relaxed);
+            r->next_ = head_.load(boost::memory_order_relaxed);
+            while (!head_.compare_exchange_weak(r->next_, r, boost::memory_order_release, boost::memory_order_relaxed));
+            size_.fetch_add(1, boost::memory_order_relaxed);
+        }
+
+        thread_record_cache::add(id_, r, this, &thread_record_list::on_exit);
+        return *r;
+    }
+
+    /// First record, follow \c next_ for the rest
+    Record* head() const
+    {
+        return head_.load(boost::memory_order_acquire);
+    }
+
+    /// Number of records
+    size_t size() const
+    {
+        return size_.load(boost::memory_order_relaxed);
+    }
+
+private:
+    static void on_exit(void* owner, void* record)
+    {
+        thread_record_list& self = *static_cast<thread_record_list*>(owner);
+        Record& r = *static_cast<Record*>(record);
+
+        if (self.hook_)
+            self.hook_(r, self.context_);
+
+        r.in_use_.store(false, boost::memory_order_release);
+    }
+
+    boost::uint64_t id_;
+    const exit_hook hook_;
+    void* const context_;
+    boost::atomic<Record*> head_;
+    boost::atomic<size_t> size_;
+};
+
+}}}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "cpu_relax.hpp"
+#include "event_count.hpp"
+
+#include <tcl/cache_line.hpp>
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <utility>
+
+namespace tcl { namespace containers {
+
+/// \brief Queue wrapper that adds blocking pop.
+///
+/// Pushes through wrapper notify \c event_count after queue has published
+/// value. \c wait_pop spins on \c try_pop for a while, then yields, and only
+/// after that parks thread on \c event_count. When nobody sleeps notify costs
+/// one fence and one load. Queues themselves don`t notify, so programs that
+/// never block keep fence-free push and pay nothing for this.
+///
+/// Values must be pushed only through wrapper, otherwise sleeping consumer
+/// may miss them.
+///
+/// \tparam Queue - queue with bool try_pop(T&) and push, and optionally
+///                 try_push, try_push_range and push_range.
+template<typename Queue>
+class waitable_queue : public Queue
+{
+    static const unsigned spin_count = 128;
+    static const unsigned yield_count = 16;
+
+public:
+    typedef event_count::clock_type clock_type;
+
+    template<typename... Args>
+    explicit waitable_queue(Args&&... args)
+        : Queue(std::forward<Args>(args)...)
+    {
+    }
+
+    template<typename T>
+    void push(const T& value)
+    {
+        Queue::push(value);
+        not_empty_.notify_one();
+    }
+
+    /// Bounded queues only
+    template<typename T>
+    bool try_push(const T& value)
+    {
+        if (!Queue::try_push(value))
+            return false;
+
+        not_empty_.notify_one();
+        return true;
+    }
+
+    /// Bounded queues only
+    template<typename InputIterator>
+    InputIterator try_push_range(InputIterator first, InputIterator last)
+    {
+        InputIterator rest = first;
+        try
+        {
+            rest = Queue::try_push_range(first, last);
+        }
+        catch(...)
+        {
+            // Values constructed before exception are published
+            not_empty_.notify_one();
+            throw;
+        }
+
+        if (rest != first)
+            not_empty_.notify_one();
+
+        return rest;
+    }
+
+    template<typename InputIterator>
+    void push_range(InputIterator first, InputIterator last)
+    {
+        push_range_impl(first, last, 0);
+    }
+
+    /// Pop value, block while queue is empty.
+    template<typename T>
+    void wait_pop(T& result)
+    {
+        if (spin_pop(result))
+            return;
+
+        for(;;)
+        {
+            const event_count::key_type key = not_empty_.prepare_wait();
+            if (this->try_pop(result))
+            {
+                not_empty_.cancel_wait();
+                return;
+            }
+
+            not_empty_.commit_wait(key);
+            if (this->try_pop(result))
+                return;
+        }
+    }
+
+    /// Pop value, block while queue is empty but not longer than timeout.
+    /// Return false if timeout has expired.
+    template<typename T, typename Rep, typename Period>
+    bool wait_pop_for(T& result, const boost::chrono::duration<Rep, Period>& timeout)
+    {
+        const clock_type::time_point deadline = clock_type::now() + timeout;
+
+        if (spin_pop(result))
+            return true;
+
+        for(;;)
+        {
+            const event_count::key_type key = not_empty_.prepare_wait();
+            if (this->try_pop(result))
+            {
+                not_empty_.cancel_wait();
+                return true;
+            }
+
+            const bool in_time = not_empty_.commit_wait_until(key, deadline);
+            if (this->try_pop(result))
+                return true;
+
+            if (!in_time)
+                return false;
+        }
+    }
+
+private:
+    // Bounded queue publishes range in parts while waiting for free space,
+    // consumer must be woken after every part, or both may wait forever
+    template<typename InputIterator, typename Q = Queue>
+    auto push_range_impl(InputIterator first, InputIterator last, int)
+        -> decltype(std::declval<Q&>().try_push_range(first, last), void())
+    {
+        while ((first = try_push_range(first, last)) != last)
+            boost::this_thread::yield();
+    }
+
+    template<typename InputIterator>
+    void push_range_impl(InputIterator first, InputIterator last, long)
+    {
+        try
+        {
+            Queue::push_range(first, last);
+        }
+        catch(...)
+        {
+            not_empty_.notify_one();
+            throw;
+        }
+
+        not_empty_.notify_one();
+    }
+
+    template<typename T>
+    bool spin_pop(T& result)
+    {
+        for (unsigned i = 0; i < spin_count; ++i)
+        {
+            if (this->try_pop(result))
+                return true;
+
+            detail::cpu_relax();
+        }
+
+        for (unsigned i = 0; i < yield_count; ++i)
+        {
+            if (this->try_pop(result))
+                return true;
+
+            boost::this_thread::yield();
+        }
+
+        return false;
+    }
+
+    // Read by every notify, keep it off the lines of the queue
+    char pad0_[cache_line_size];
+    event_count not_empty_;
+    char pad1_[cache_line_size];
+};
+
+}}
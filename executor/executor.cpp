@@ -0,0 +1,199 @@
+#include "executor.hpp"
+
+#include <tcl/containers/cpu_relax.hpp>
+#include <tcl/containers/lf_ws_deque.hpp>
+
+#include <boost/bind/bind.hpp>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace tcl {
+
+namespace detail {
+
+struct executor_worker
+{
+    executor_worker(executor& owner, size_t index)
+        : owner_(owner)
+        , index_(index)
+        , seed_(static_cast<boost::uint32_t>(index) * 2654435761u + 1)
+    {}
+
+    /// xorshift, good enough to pick victim
+    boost::uint32_t random()
+    {
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 17;
+        seed_ ^= seed_ << 5;
+        return seed_;
+    }
+
+    executor& owner_;
+    const size_t index_;
+    boost::uint32_t seed_;
+    containers::lf_ws_deque<executor_task*> tasks_;
+};
+
+}
+
+namespace {
+
+/// Worker that runs on current thread, if any
+thread_local detail::executor_worker* g_current_worker = 0;
+
+/// Rounds of looking for work before worker goes to sleep
+const unsigned spin_rounds = 64;
+
+void pin_current_thread(size_t cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (cpu % (sizeof(DWORD_PTR) * 8)));
+#endif
+}
+
+}
+
+executor::executor(size_t threads, bool pin_threads, boost::uint16_t pooled_tasks)
+    : task_pool_(pooled_tasks, sizeof(task))
+    , stop_(false)
+{
+    if (!threads)
+        threads = boost::thread::hardware_concurrency();
+    if (!threads)
+        threads = 1;
+
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+        workers_.push_back(new worker(*this, i));
+
+    for (size_t i = 0; i < threads; ++i)
+        threads_.create_thread(boost::bind(&executor::worker_proc, this, workers_[i], pin_threads));
+}
+
+executor::~executor()
+{
+    stop_.store(true, boost::memory_order_release);
+    idle_.notify_all();
+    threads_.join_all();
+
+    for (size_t i = 0; i < workers_.size(); ++i)
+        delete workers_[i];
+}
+
+size_t executor::size() const
+{
+    return workers_.size();
+}
+
+std::exception_ptr executor::first_error() const
+{
+    boost::mutex::scoped_lock l(error_guard_);
+    return error_;
+}
+
+void executor::free_task_memory(void* p)
+{
+    if (task_pool_.is_my_ptr(p))
+        task_pool_.deallocate(p);
+    else
+        ::operator delete(p);
+}
+
+void executor::schedule(task* t)
+{
+    worker* w = g_current_worker;
+    if (w && &w->owner_ == this)
+        w->tasks_.push_bottom(t);
+    else
+        injection_.push(t);
+}
+
+bool executor::find_task(worker& w, task*& t)
+{
+    if (w.tasks_.pop_bottom(t) || injection_.try_pop(t))
+        return true;
+
+    const size_t n = workers_.size();
+    const size_t first = w.random() % n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        worker* victim = workers_[(first + i) % n];
+        if (victim != &w && victim->tasks_.steal(t))
+            return true;
+    }
+
+    return false;
+}
+
+void executor::run_task(task* t)
+{
+    try
+    {
+        t->run();
+    }
+    catch(...)
+    {
+        boost::mutex::scoped_lock l(error_guard_);
+        if (!error_)
+            error_ = std::current_exception();
+    }
+
+    t->~task();
+    free_task_memory(t);
+}
+
+void executor::worker_proc(worker* w, bool pin)
+{
+    if (pin)
+        pin_current_thread(w->index_);
+
+    g_current_worker = w;
+
+    task* t;
+    for(;;)
+    {
+        bool found = false;
+        for (unsigned i = 0; i < spin_rounds && !found; ++i)
+        {
+            found = find_task(*w, t);
+            if (!found)
+                containers::detail::cpu_relax();
+        }
+
+        if (found)
+        {
+            run_task(t);
+            continue;
+        }
+
+        const containers::event_count::key_type key = idle_.prepare_wait();
+        if (find_task(*w, t))
+        {
+            idle_.cancel_wait();
+            run_task(t);
+            continue;
+        }
+
+        if (stop_.load(boost::memory_order_acquire))
+        {
+            idle_.cancel_wait();
+            break;
+        }
+
+        idle_.commit_wait(key);
+    }
+
+    g_current_worker = 0;
+}
+
+}
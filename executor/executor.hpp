@@ -0,0 +1,215 @@
+#pragma once
+
+#include <tcl/allocators/fixed_pool.hpp>
+#include <tcl/containers/event_count.hpp>
+#include <tcl/containers/lf_mpmc_ring.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tcl {
+
+namespace detail {
+
+/// \brief Type erased callable that fits to one pool chunk.
+///
+/// Callables up to \c storage_size bytes are stored inline, bigger ones are
+/// moved to heap.
+class executor_task
+{
+public:
+    /// Whole task takes one cache line
+    typedef std::integral_constant<size_t, 48> storage_size;
+    typedef boost::alignment_of<std::max_align_t> storage_alignment;
+
+private:
+    template<typename F>
+    struct fits : std::integral_constant<bool,
+        sizeof(F) <= storage_size::value &&
+        boost::alignment_of<F>::value <= storage_alignment::value>
+    {};
+
+public:
+    template<typename F>
+    explicit executor_task(F&& f)
+    {
+        init(std::forward<F>(f), fits<typename std::decay<F>::type>());
+    }
+
+    /// Call stored callable and destroy it
+    void run()
+    {
+        call_(this, true);
+    }
+
+    /// Destroy stored callable without calling it
+    void discard()
+    {
+        call_(this, false);
+    }
+
+private:
+    executor_task(const executor_task&);
+    executor_task& operator=(const executor_task&);
+
+    template<typename F>
+    void init(F&& f, std::true_type)
+    {
+        typedef typename std::decay<F>::type callable;
+        new (&storage_) callable(std::forward<F>(f));
+        call_ = &executor_task::call_inline<callable>;
+    }
+
+    template<typename F>
+    void init(F&& f, std::false_type)
+    {
+        typedef typename std::decay<F>::type callable;
+        *static_cast<callable**>(static_cast<void*>(&storage_)) = new callable(std::forward<F>(f));
+        call_ = &executor_task::call_heap<callable>;
+    }
+
+    template<typename F>
+    static void call_inline(executor_task* t, bool run)
+    {
+        F& f = *static_cast<F*>(static_cast<void*>(&t->storage_));
+        destroyer<F> d(&f);
+        if (run)
+            f();
+    }
+
+    template<typename F>
+    static void call_heap(executor_task* t, bool run)
+    {
+        F* f = *static_cast<F**>(static_cast<void*>(&t->storage_));
+        std::unique_ptr<F> d(f);
+        if (run)
+            (*f)();
+    }
+
+    template<typename F>
+    struct destroyer
+    {
+        destroyer(F* f) : f_(f) {}
+        ~destroyer() { f_->~F(); }
+        F* f_;
+    };
+
+    void (*call_)(executor_task*, bool);
+    boost::aligned_storage<storage_size::value, storage_alignment::value>::type storage_;
+};
+
+struct executor_worker;
+
+}
+
+/// \brief Work-stealing thread pool.
+///
+/// Each worker has its own lock-free work-stealing deque. Tasks posted from
+/// worker go to its deque, tasks posted from other threads go to shared
+/// injection queue. Worker looks for task in own deque, then in injection
+/// queue, then tries to steal from other workers starting from random one.
+/// Idle workers park on \c event_count, so posting to pool with busy workers
+/// doesn`t issue any syscalls.
+///
+/// Tasks are kept in lock-free pool of fixed size chunks, small callables are
+/// stored there inline, so \c post and \c post_batch don`t allocate unless pool
+/// is exhausted or callable is too big.
+///
+/// Destructor waits until all posted tasks are done. Exception thrown by task
+/// is caught by worker, the first one is kept for \c first_error and the
+/// rest are dropped, worker goes on with other tasks.
+class executor
+{
+    typedef detail::executor_task task;
+    typedef detail::executor_worker worker;
+
+    executor(const executor&);
+    executor& operator=(const executor&);
+
+public:
+    /// \param threads - number of workers, 0 means number of cores.
+    /// \param pin_threads - bind worker n to core n modulo number of cores.
+    /// \param pooled_tasks - number of tasks that can be queued without allocation.
+    explicit executor(size_t threads = 0, bool pin_threads = false, boost::uint16_t pooled_tasks = 4096);
+    ~executor();
+
+    /// Schedule callable for execution. If it throws, see \c first_error.
+    template<typename F>
+    void post(F&& f)
+    {
+        schedule(create_task(std::forward<F>(f)));
+        idle_.notify_one();
+    }
+
+    /// Schedule all callables from [first, last) for execution.
+    /// Idle workers are woken once for the whole batch.
+    template<typename InputIterator>
+    void post_batch(InputIterator first, InputIterator last)
+    {
+        size_t n = 0;
+        for (; first != last; ++first, ++n)
+            schedule(create_task(*first));
+
+        if (n > 1)
+            idle_.notify_all();
+        else if (n)
+            idle_.notify_one();
+    }
+
+    /// Number of worker threads
+    size_t size() const;
+
+    /// First exception thrown by task, null if no task has thrown
+    std::exception_ptr first_error() const;
+
+private:
+    friend struct detail::executor_worker;
+
+    template<typename F>
+    task* create_task(F&& f)
+    {
+        void* p = task_pool_.allocate();
+        if (!p)
+            p = ::operator new(sizeof(task));
+
+        try
+        {
+            return new (p) task(std::forward<F>(f));
+        }
+        catch(...)
+        {
+            free_task_memory(p);
+            throw;
+        }
+    }
+
+    void free_task_memory(void* p);
+    void schedule(task* t);
+    bool find_task(worker& w, task*& t);
+    void run_task(task* t);
+    void worker_proc(worker* w, bool pin);
+
+    allocators::fixed_pool<> task_pool_;
+    containers::lf_mpmc_ring<task*, 4096> injection_;
+    containers::event_count idle_;
+    boost::atomic<bool> stop_;
+
+    mutable boost::mutex error_guard_;
+    std::exception_ptr error_;
+
+    std::vector<worker*> workers_;
+    boost::thread_group threads_;
+};
+
+}
@@ -0,0 +1,206 @@
+#include "../executor.hpp"
+
+#include <tcl/containers/lb_queue.hpp>
+#include <tcl/containers/waitable_queue.hpp>
+
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/chrono/chrono_io.hpp>
+
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+typedef boost::chrono::steady_clock clock_type;
+
+const int FAN_OUT_TASKS = 100000;
+const int FORK_JOIN_DEPTH = 16;
+
+using namespace std;
+
+/// Thread pool around single lb_queue, that is what everybody writes
+class lb_queue_pool
+{
+public:
+    explicit lb_queue_pool(size_t threads)
+    {
+        for (size_t i = 0; i < threads; ++i)
+            threads_.create_thread(std::bind(&lb_queue_pool::worker_proc, this));
+    }
+
+    ~lb_queue_pool()
+    {
+        // Empty function stops worker
+        for (size_t i = 0; i < threads_.size(); ++i)
+            queue_.push(std::function<void()>());
+
+        threads_.join_all();
+    }
+
+    template<typename F>
+    void post(F f)
+    {
+        queue_.push(f);
+    }
+
+    template<typename InputIterator>
+    void post_batch(InputIterator first, InputIterator last)
+    {
+        for (; first != last; ++first)
+            queue_.push(*first);
+    }
+
+private:
+    void worker_proc()
+    {
+        for(;;)
+        {
+            std::function<void()> f;
+            queue_.wait_pop(f);
+            if (!f)
+                break;
+
+            f();
+        }
+    }
+
+    tcl::containers::waitable_queue<tcl::containers::lb_queue<std::function<void()>>> queue_;
+    boost::thread_group threads_;
+};
+
+void wait_for(const boost::atomic<int>& counter, int value)
+{
+    while (counter.load(boost::memory_order_acquire) != value)
+        boost::this_thread::yield();
+}
+
+/// Every task below max depth spawns two children, leaves count themselves
+template<typename Pool>
+struct fork_task
+{
+    void operator()() const
+    {
+        if (depth_ == FORK_JOIN_DEPTH)
+        {
+            leaves_->fetch_add(1, boost::memory_order_release);
+            return;
+        }
+
+        fork_task child = {pool_, leaves_, depth_ + 1};
+        pool_->post(child);
+        pool_->post(child);
+    }
+
+    Pool* pool_;
+    boost::atomic<int>* leaves_;
+    int depth_;
+};
+
+template<typename Pool>
+void fork_join_test(Pool& pool, const char* name)
+{
+    boost::atomic<int> leaves(0);
+
+    clock_type::time_point tp1 = clock_type::now();
+    fork_task<Pool> root = {&pool, &leaves, 0};
+    pool.post(root);
+    wait_for(leaves, 1 << FORK_JOIN_DEPTH);
+    clock_type::time_point tp2 = clock_type::now();
+
+    cout << name << " fork/join: " << tp2 - tp1 << " tasks: " << (2 << FORK_JOIN_DEPTH) - 1 << endl;
+}
+
+struct count_task
+{
+    void operator()() const
+    {
+        done_->fetch_add(1, boost::memory_order_release);
+    }
+
+    boost::atomic<int>* done_;
+};
+
+template<typename Pool>
+void fan_out_test(Pool& pool, const char* name)
+{
+    boost::atomic<int> done(0);
+    count_task t = {&done};
+
+    clock_type::time_point tp1 = clock_type::now();
+    for (int i = 0; i < FAN_OUT_TASKS; ++i)
+        pool.post(t);
+
+    wait_for(done, FAN_OUT_TASKS);
+    clock_type::time_point tp2 = clock_type::now();
+
+    cout << name << " fan-out: " << tp2 - tp1 << " tasks: " << FAN_OUT_TASKS << endl;
+}
+
+template<typename Pool>
+void fan_out_batch_test(Pool& pool, const char* name)
+{
+    boost::atomic<int> done(0);
+    count_task t = {&done};
+    std::vector<count_task> batch(64, t);
+
+    clock_type::time_point tp1 = clock_type::now();
+    for (int i = 0; i < FAN_OUT_TASKS; i += batch.size())
+        pool.post_batch(batch.begin(), batch.end());
+
+    const int total = (FAN_OUT_TASKS + batch.size() - 1) / batch.size() * batch.size();
+    wait_for(done, total);
+    clock_type::time_point tp2 = clock_type::now();
+
+    cout << name << " fan-out batch 64: " << tp2 - tp1 << " tasks: " << total << endl;
+}
+
+// Task that throws must not kill worker, its exception is kept
+void task_error_test(tcl::executor& pool)
+{
+    boost::atomic<int> done(0);
+    count_task t = {&done};
+
+    pool.post([] { throw std::runtime_error("task error"); });
+    for (int i = 0; i < 100; ++i)
+        pool.post(t);
+
+    wait_for(done, 100);
+
+    // Throwing task may still be unwinding on other worker
+    const clock_type::time_point deadline = clock_type::now() + boost::chrono::seconds(10);
+    while (!pool.first_error() && clock_type::now() < deadline)
+        boost::this_thread::yield();
+
+    cout << "executor task error: " << (pool.first_error() ? "kept" : "LOST") << endl;
+}
+
+int main()
+{
+    const size_t threads = boost::thread::hardware_concurrency();
+
+    {
+        lb_queue_pool pool(threads);
+        fork_join_test(pool, "lb_queue_pool");
+        fan_out_test(pool, "lb_queue_pool");
+        fan_out_batch_test(pool, "lb_queue_pool");
+    }
+
+    {
+        tcl::executor pool(threads);
+        fork_join_test(pool, "executor");
+        fan_out_test(pool, "executor");
+        fan_out_batch_test(pool, "executor");
+        task_error_test(pool);
+    }
+
+    {
+        tcl::executor pool(threads, true);
+        fork_join_test(pool, "executor pinned");
+        fan_out_test(pool, "executor pinned");
+        fan_out_batch_test(pool, "executor pinned");
+    }
+
+    return 0;
+}
@@ -0,0 +1,237 @@
+///
+/// \file
+///
+/// \brief Hardware performance counters of calling thread for benchmarks.
+///
+/// Counters are opened with perf_event_open, so they exist only on linux and
+/// only where kernel lets user to open them (see perf_event_paranoid). Every
+/// counter is opened separately and the ones that fail are reported as
+/// unavailable, the rest still work. In virtual machines and containers it
+/// is usual to have software counters only, or nothing at all.
+///
+
+#ifndef TCL_PERF_COUNTERS_INCLUDED
+#define TCL_PERF_COUNTERS_INCLUDED
+
+#include <boost/cstdint.hpp>
+
+#include <ostream>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+namespace tcl {
+
+/// \brief Set of counters that count events of calling thread between
+/// \c start and \c stop.
+///
+/// Disabled object doesn`t open anything and prints nothing, so benchmark
+/// can create it unconditionally and enable it by command line.
+class perf_counters
+{
+    perf_counters(const perf_counters&);
+    perf_counters& operator=(const perf_counters&);
+
+public:
+    enum counter
+    {
+        cycles,
+        instructions,
+        l1d_misses,
+        llc_misses,
+        context_switches,
+        counters_count
+    };
+
+    explicit perf_counters(bool enabled = true)
+    {
+        for (int i = 0; i < counters_count; ++i)
+        {
+            fds_[i] = -1;
+            values_[i] = 0;
+        }
+
+        if (enabled)
+            for (int i = 0; i < counters_count; ++i)
+                fds_[i] = open_counter(static_cast<counter>(i));
+    }
+
+    ~perf_counters()
+    {
+#if defined(__linux__)
+        for (int i = 0; i < counters_count; ++i)
+            if (fds_[i] != -1)
+                close(fds_[i]);
+#endif
+    }
+
+    /// At least one counter works
+    bool available() const
+    {
+        for (int i = 0; i < counters_count; ++i)
+            if (valid(static_cast<counter>(i)))
+                return true;
+
+        return false;
+    }
+
+    bool valid(counter c) const
+    {
+        return fds_[c] != -1;
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        for (int i = 0; i < counters_count; ++i)
+        {
+            if (fds_[i] == -1)
+                continue;
+
+            ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void stop()
+    {
+#if defined(__linux__)
+        for (int i = 0; i < counters_count; ++i)
+        {
+            if (fds_[i] == -1)
+                continue;
+
+            ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            // Counter could be multiplexed with other users, scale it to
+            // the whole time it was enabled
+            boost::uint64_t data[3];
+            if (read(fds_[i], data, sizeof(data)) != sizeof(data) || !data[2])
+            {
+                values_[i] = 0;
+                continue;
+            }
+
+            values_[i] = data[1] == data[2]
+                ? data[0]
+                : static_cast<boost::uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+        }
+#endif
+    }
+
+    /// Events counted by last start/stop
+    boost::uint64_t value(counter c) const
+    {
+        return values_[c];
+    }
+
+    static const char* name(counter c)
+    {
+        static const char* const names[counters_count] = {
+            "cycles", "instructions", "l1d-misses", "llc-misses", "context-switches"
+        };
+
+        return names[c];
+    }
+
+    /// Print " name/op value" for every counter, unavailable ones as n/a.
+    /// Prints nothing when counters are disabled or none is available.
+    void print_per_op(std::ostream& os, boost::uint64_t ops) const
+    {
+        if (!available() || !ops)
+            return;
+
+        for (int i = 0; i < counters_count; ++i)
+        {
+            const counter c = static_cast<counter>(i);
+            os << " " << name(c) << "/op ";
+            if (valid(c))
+                os << static_cast<double>(value(c)) / ops;
+            else
+                os << "n/a";
+        }
+    }
+
+    /// Print which counters could be opened
+    void print_availability(std::ostream& os) const
+    {
+        os << "perf counters:";
+        for (int i = 0; i < counters_count; ++i)
+        {
+            const counter c = static_cast<counter>(i);
+            os << " " << name(c) << (valid(c) ? "" : " (n/a)");
+        }
+
+        if (!available())
+            os << ", none available, check /proc/sys/kernel/perf_event_paranoid";
+    }
+
+private:
+    static int open_counter(counter c)
+    {
+#if defined(__linux__)
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        switch (c)
+        {
+        case cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case l1d_misses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case llc_misses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        default:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            break;
+        }
+
+        // Context switches happen in kernel, so count kernel side if allowed,
+        // hardware events are counted in user space only, that is permitted
+        // with stricter perf_event_paranoid
+        attr.exclude_kernel = c == context_switches ? 0 : 1;
+        int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd == -1 && !attr.exclude_kernel)
+        {
+            attr.exclude_kernel = 1;
+            fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        return fd;
+#else
+        (void)c;
+        return -1;
+#endif
+    }
+
+    int fds_[counters_count];
+    boost::uint64_t values_[counters_count];
+};
+
+}
+
+#endif
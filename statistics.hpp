@@ -0,0 +1,207 @@
+///
+/// \file
+///
+/// \brief Contention and reclamation counters of lock-free containers.
+///
+/// Counting is compiled in only when TCL_STATISTICS is defined (cmake option
+/// of the same name). Otherwise \c statistics_counters is empty and all its
+/// functions are inline no-ops, so instrumented code is the same as without
+/// them and \c get_statistics of containers returns zeros.
+///
+/// Counters are kept in shards, thread updates shard picked once per thread,
+/// so that counting doesn`t add contention on the cache line it measures.
+/// Shards are summed when statistics are requested.
+///
+
+#ifndef TCL_STATISTICS_INCLUDED
+#define TCL_STATISTICS_INCLUDED
+
+#include <tcl/cache_line.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/static_assert.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+namespace tcl {
+
+/// \brief Snapshot of counters.
+struct statistics
+{
+    statistics()
+        : operations_(0)
+        , cas_failures_(0)
+        , scans_(0)
+        , freed_(0)
+        , retired_high_water_(0)
+    {
+    }
+
+    boost::uint64_t operations_;            //!< Completed operations
+    boost::uint64_t cas_failures_;          //!< Failed CAS in retry loops of those operations
+    boost::uint64_t scans_;                 //!< Reclamation passes, hazard pointer scans or limbo list recycles
+    boost::uint64_t freed_;                 //!< Nodes freed by scans
+    boost::uint64_t retired_high_water_;    //!< Longest reclaim list of single thread
+
+    double cas_failures_per_operation() const
+    {
+        return operations_ ? static_cast<double>(cas_failures_) / operations_ : 0;
+    }
+
+    double freed_per_scan() const
+    {
+        return scans_ ? static_cast<double>(freed_) / scans_ : 0;
+    }
+
+    /// Add counters of other part of container, e.g. its reclamation domain
+    statistics& merge(const statistics& other)
+    {
+        operations_ += other.operations_;
+        cas_failures_ += other.cas_failures_;
+        scans_ += other.scans_;
+        freed_ += other.freed_;
+        retired_high_water_ = (std::max)(retired_high_water_, other.retired_high_water_);
+        return *this;
+    }
+};
+
+#if defined(TCL_STATISTICS)
+
+/// \brief Sharded counters, see file description.
+class statistics_counters
+{
+    statistics_counters(const statistics_counters&);
+    statistics_counters& operator=(const statistics_counters&);
+
+public:
+    static const size_t shards_count = 64;
+
+    statistics_counters()
+        : storage_(new char[shards_count * sizeof(shard) + cache_line_size])
+        , shards_(reinterpret_cast<shard*>(
+            (reinterpret_cast<boost::uintptr_t>(storage_) + cache_line_size - 1) & ~boost::uintptr_t(cache_line_size - 1)))
+    {
+        BOOST_STATIC_ASSERT(sizeof(shard) % cache_line_size == 0);
+
+        for (size_t i = 0; i < shards_count; ++i)
+            new (shards_ + i) shard();
+    }
+
+    ~statistics_counters()
+    {
+        for (size_t i = 0; i < shards_count; ++i)
+            shards_[i].~shard();
+
+        delete[] storage_;
+    }
+
+    /// Operation completed after \c cas_failures failed attempts
+    void operation(unsigned cas_failures)
+    {
+        shard& s = local();
+        s.operations_.fetch_add(1, boost::memory_order_relaxed);
+        if (cas_failures)
+            s.cas_failures_.fetch_add(cas_failures, boost::memory_order_relaxed);
+    }
+
+    /// Scan freed \c freed nodes
+    void scan(size_t freed)
+    {
+        shard& s = local();
+        s.scans_.fetch_add(1, boost::memory_order_relaxed);
+        s.freed_.fetch_add(freed, boost::memory_order_relaxed);
+    }
+
+    /// Reclaim list of current thread has grown to \c size
+    void retired(size_t size)
+    {
+        boost::atomic<boost::uint64_t>& hw = local().retired_high_water_;
+        boost::uint64_t old = hw.load(boost::memory_order_relaxed);
+        while (old < size && !hw.compare_exchange_weak(old, size, boost::memory_order_relaxed));
+    }
+
+    statistics get() const
+    {
+        statistics result;
+        for (size_t i = 0; i < shards_count; ++i)
+        {
+            const shard& s = shards_[i];
+            result.operations_ += s.operations_.load(boost::memory_order_relaxed);
+            result.cas_failures_ += s.cas_failures_.load(boost::memory_order_relaxed);
+            result.scans_ += s.scans_.load(boost::memory_order_relaxed);
+            result.freed_ += s.freed_.load(boost::memory_order_relaxed);
+            result.retired_high_water_ = (std::max)(
+                result.retired_high_water_, s.retired_high_water_.load(boost::memory_order_relaxed));
+        }
+
+        return result;
+    }
+
+private:
+    struct shard
+    {
+        shard()
+            : operations_(0)
+            , cas_failures_(0)
+            , scans_(0)
+            , freed_(0)
+            , retired_high_water_(0)
+        {
+        }
+
+        boost::atomic<boost::uint64_t> operations_;
+        boost::atomic<boost::uint64_t> cas_failures_;
+        boost::atomic<boost::uint64_t> scans_;
+        boost::atomic<boost::uint64_t> freed_;
+        boost::atomic<boost::uint64_t> retired_high_water_;
+
+        char pad_[cache_line_tail<5 * sizeof(boost::uint64_t)>::value];
+    };
+
+    /// Threads take shards round robin, they share shard only when there
+    /// are more of them than shards, so updates are atomic anyway
+    shard& local()
+    {
+        static boost::atomic<unsigned> next(0);
+        static thread_local unsigned index = next.fetch_add(1, boost::memory_order_relaxed) % shards_count;
+        return shards_[index];
+    }
+
+    // Shards start on line boundary and take whole lines, so no two of
+    // them share a line. Padding alone can`t do that, array may start at
+    // any offset inside container, and operator new doesn`t align to line.
+    char* const storage_;
+    shard* const shards_;
+};
+
+#else
+
+class statistics_counters
+{
+public:
+    void operation(unsigned)
+    {
+    }
+
+    void scan(size_t)
+    {
+    }
+
+    void retired(size_t)
+    {
+    }
+
+    statistics get() const
+    {
+        return statistics();
+    }
+};
+
+#endif
+
+}
+
+#endif